@@ -0,0 +1,69 @@
+/** Example sketch which controls the player without ever waiting for it.
+ *
+ *  Commands are queued and the status is requested in the background, 
+ *  mp3.update() does the actual talking to the JQ8400 each time through
+ *  loop() so the rest of your loop (here, blinking the LED) never stalls.
+ *
+ * @author James Sleeman,  http://sparks.gogo.co.nz/
+ * @license MIT License
+ * @file
+ */
+
+// This example uses SoftwareSerial on pin 8 and 9
+#include <SoftwareSerial.h>
+SoftwareSerial mySoftwareSerial(8,9);
+
+// Create the mp3 connection itself, notice how we give it the 
+//  serial object we want it to use to talk to the JQ8400 module.
+// For example you might use mp3(Serial2) instead of a SoftwareSerial
+#include <JQ8400_Serial.h>
+JQ8400_Serial mp3(mySoftwareSerial);
+
+// The queue is only there when the library is built with it
+#if !MP3_ASYNC
+  #error "This example needs MP3_ASYNC, define it as 1 in JQ8400_Serial.h"
+#endif
+
+// This is filled in by mp3.update() when the status request completes
+MP3Result status;
+
+// This is called by mp3.update() when the status request completes
+void statusReceived(JQ8400_Serial &player, MP3Result &result)
+{
+  if(result.state == MP3_RESULT_OK && result.value == MP3_STATUS_STOPPED)
+  {
+    Serial.println(F("Stopped, playing next file."));
+    player.next();
+  }
+}
+
+void setup() 
+{
+  Serial.begin(9600);
+  pinMode(LED_BUILTIN, OUTPUT);
+  
+  mySoftwareSerial.begin(9600);
+  mp3.reset();
+  
+  // From here on play(), next(), setVolume() etc are queued, not sent immediately
+  mp3.setAsync(true);
+  mp3.setVolume(20);
+  mp3.play();
+  
+  mp3.requestStatus(&status, statusReceived);
+}
+
+void loop() 
+{
+  // Send and receive whatever is ready, this never waits
+  mp3.update();
+  
+  // When the last status request has completed, ask again
+  if(status.state != MP3_RESULT_PENDING)
+  {
+    mp3.requestStatus(&status, statusReceived);
+  }
+  
+  // Meanwhile we are free to do other things
+  digitalWrite(LED_BUILTIN, (millis() / 250) % 2);
+}
@@ -0,0 +1,712 @@
+/**
+ * Software model of a JQ8400 MP3 Module, for testing without hardware.
+ *
+ * Copyright (C) 2019 James Sleeman, <http://sparks.gogo.co.nz/jq6500/index.html>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author James Sleeman, http://sparks.gogo.co.nz/
+ * @license MIT License
+ * @file
+ */
+
+#include <Arduino.h>
+#include "JQ8400_Emulator.h"
+
+JQ8400_Emulator::JQ8400_Emulator()
+{
+  lastTick = clockMillis();
+}
+
+uint16_t JQ8400_Emulator::addFile(uint8_t source, const char *path, uint16_t lengthSeconds)
+{
+  if(fileCount >= JQ8400_EMULATOR_MAX_FILES) return 0;
+
+  File &f = files[fileCount++];
+  f.source        = source;
+  f.lengthSeconds = lengthSeconds;
+  strncpy(f.path, path, sizeof(f.path)-1);
+  f.path[sizeof(f.path)-1] = 0;
+
+  sources |= 1<<source;
+
+  uint16_t index = 0;
+  for(uint8_t x = 0; x < fileCount; x++)
+  {
+    if(files[x].source == source) index++;
+  }
+  return index;
+}
+
+void JQ8400_Emulator::clearFiles()
+{
+  fileCount    = 0;
+  sources      = 0;
+  status       = MP3_STATUS_STOPPED;
+  currentIndex = 1;
+  positionMs   = 0;
+}
+
+void JQ8400_Emulator::setSourceAvailable(uint8_t source, uint8_t available)
+{
+  if(available)
+  {
+    sources |= 1<<source;
+  }
+  else
+  {
+    sources &= ~(1<<source);
+  }
+}
+
+JQ8400_Emulator::File *JQ8400_Emulator::fileByIndex(uint16_t index)
+{
+  if(!(sources & (1<<source))) return 0;
+
+  for(uint8_t x = 0; x < fileCount; x++)
+  {
+    if(files[x].source != source) continue;
+    if(--index == 0) return &files[x];
+  }
+  return 0;
+}
+
+uint16_t JQ8400_Emulator::countFiles()
+{
+  if(!(sources & (1<<source))) return 0;
+
+  uint16_t count = 0;
+  for(uint8_t x = 0; x < fileCount; x++)
+  {
+    if(files[x].source == source) count++;
+  }
+  return count;
+}
+
+uint8_t JQ8400_Emulator::folderOf(File *f, const char **name)
+{
+  const char *p = f->path;
+  if(*p == '/') p++;
+
+  const char *slash = strchr(p, '/');
+  if(!slash) return 0;
+
+  *name = p;
+  return slash - p;
+}
+
+uint16_t JQ8400_Emulator::folderRange(uint16_t index, uint16_t *count)
+{
+  File *f = fileByIndex(index);
+  *count  = 0;
+  if(!f) return 0;
+
+  const char *folder;
+  uint8_t     folderLength = folderOf(f, &folder);
+
+  uint16_t first = 0;
+  uint16_t total = countFiles();
+  for(uint16_t x = 1; x <= total; x++)
+  {
+    const char *other;
+    uint8_t     otherLength = folderOf(fileByIndex(x), &other);
+    if(otherLength != folderLength || strncmp(folder, other, folderLength)) continue;
+
+    if(!first) first = x;
+    (*count)++;
+  }
+
+  return first;
+}
+
+uint16_t JQ8400_Emulator::findByPattern(const char *pattern, uint8_t length)
+{
+  // The JQ8400 wants each path component to be a prefix followed by a '*'
+  //  and the file to end in "*???" (ie any extension), so we just match each
+  //  component by prefix, which is close enough for our purposes.
+  uint16_t total = countFiles();
+  for(uint16_t x = 1; x <= total; x++)
+  {
+    const char *path = fileByIndex(x)->path;
+    const char *p    = pattern;
+    const char *end  = pattern + length;
+    uint8_t     ok   = 1;
+
+    while(ok && p < end)
+    {
+      if(*p == '/')
+      {
+        if(*path != '/') { ok = 0; break; }
+        p++; path++;
+        continue;
+      }
+
+      // Compare the prefix up to the wildcard
+      while(p < end && *p != '*' && *p != '/')
+      {
+        if(*p != '?' && toupper(*p) != toupper(*path)) { ok = 0; break; }
+        p++; path++;
+      }
+
+      // Skip the wildcard(s) in the pattern and the rest of the component in the path
+      while(p < end && (*p == '*' || *p == '?')) p++;
+      while(*path && *path != '/') path++;
+    }
+
+    if(ok && !*path) return x;
+  }
+
+  return 0;
+}
+
+uint32_t JQ8400_Emulator::random(uint32_t limit)
+{
+  // xorshift32, deterministic for a given seed
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return limit ? randomState % limit : 0;
+}
+
+uint8_t JQ8400_Emulator::startFile(uint16_t index)
+{
+  if(!fileByIndex(index)) return 0;
+
+  currentIndex = index;
+  positionMs   = 0;
+  abEnd        = 0;
+  status       = MP3_STATUS_PLAYING;
+
+  // Opening the file takes a moment
+  uint32_t now  = clockMillis();
+  startingUntil = now + startDelay + (startJitter ? random(startJitter + 1) : 0);
+  starting      = startingUntil != now;
+  return 1;
+}
+
+void JQ8400_Emulator::endOfFile()
+{
+  // An interjection returns to what was playing
+  if(interjectedIndex)
+  {
+    currentIndex     = interjectedIndex;
+    positionMs       = interjectedPosition;
+    status           = interjectedStatus;
+    interjectedIndex = 0;
+    return;
+  }
+
+  // A playlist plays through and then stops
+  if(playlistPosition < playlistLength)
+  {
+    startFile(playlist[playlistPosition++]);
+    return;
+  }
+  playlistLength = playlistPosition = 0;
+
+  uint16_t total = countFiles();
+  uint16_t folderCount;
+  uint16_t folderFirst = folderRange(currentIndex, &folderCount);
+
+  switch(loopMode)
+  {
+    case MP3_LOOP_ONE:
+      startFile(currentIndex);
+      break;
+
+    case MP3_LOOP_ALL:
+      startFile(currentIndex < total ? currentIndex + 1 : 1);
+      break;
+
+    case MP3_LOOP_ALL_STOP:
+      if(currentIndex < total)
+      {
+        startFile(currentIndex + 1);
+        break;
+      }
+      status = MP3_STATUS_STOPPED;
+      positionMs = 0;
+      break;
+
+    case MP3_LOOP_ALL_RANDOM:
+      startFile(1 + random(total));
+      break;
+
+    case MP3_LOOP_FOLDER:
+      startFile(currentIndex + 1 < folderFirst + folderCount ? currentIndex + 1 : folderFirst);
+      break;
+
+    case MP3_LOOP_FOLDER_STOP:
+      if(currentIndex + 1 < folderFirst + folderCount)
+      {
+        startFile(currentIndex + 1);
+        break;
+      }
+      status = MP3_STATUS_STOPPED;
+      positionMs = 0;
+      break;
+
+    case MP3_LOOP_FOLDER_RANDOM:
+      startFile(folderFirst + random(folderCount));
+      break;
+
+    default: // MP3_LOOP_ONE_STOP
+      status = MP3_STATUS_STOPPED;
+      positionMs = 0;
+      break;
+  }
+}
+
+void JQ8400_Emulator::tick()
+{
+  uint32_t now     = clockMillis();
+  uint32_t elapsed = now - lastTick;
+  lastTick         = now;
+
+  if(status != MP3_STATUS_PLAYING) return;
+
+  // Nothing is heard until the file has been opened
+  if(starting)
+  {
+    if((int32_t)(now - startingUntil) < 0) return;
+    elapsed  = now - startingUntil;
+    starting = 0;
+  }
+
+  while(elapsed)
+  {
+    File *f = fileByIndex(currentIndex);
+    if(!f)
+    {
+      status = MP3_STATUS_STOPPED;
+      return;
+    }
+
+    // Even an empty file takes a moment, or looping it would never end
+    uint32_t lengthMs = f->lengthSeconds ? (uint32_t)f->lengthSeconds * 1000 : 1;
+    uint32_t stopMs   = (abEnd && abEnd * 1000UL < lengthMs) ? abEnd * 1000UL : lengthMs;
+
+    if(positionMs + elapsed < stopMs)
+    {
+      positionMs += elapsed;
+      elapsed     = 0;
+    }
+    else
+    {
+      elapsed   -= stopMs - positionMs;
+      positionMs = stopMs;
+
+      if(abEnd && stopMs < lengthMs)
+      {
+        positionMs = abStart * 1000UL;
+        continue;
+      }
+
+      endOfFile();
+      if(status != MP3_STATUS_PLAYING) return;
+    }
+
+    // Position reports are sent every second while playing
+    if(reportPosition && now - lastReport >= 1000)
+    {
+      lastReport = now;
+      respondTime(0x25, positionMs / 1000);
+    }
+  }
+}
+
+void JQ8400_Emulator::respond(uint8_t command, const uint8_t *data, uint8_t length)
+{
+  uint8_t  frame[JQ8400_EMULATOR_RX_BUFFER];
+  uint16_t n = 0;
+
+  frame[n++] = 0xAA;
+  frame[n++] = command;
+  frame[n++] = length;
+  for(uint8_t x = 0; x < length && n < sizeof(frame) - 1; x++)
+  {
+    frame[n++] = data[x];
+  }
+
+  uint8_t sum = 0;
+  for(uint16_t x = 0; x < n; x++) sum += frame[x];
+  if(corruptRate && random(100) < corruptRate) sum ^= 0x5A;
+  frame[n++] = sum;
+
+  txFrames++;
+
+  // Responses start after the latency, and after anything already being sent
+  uint32_t ready = clockMillis() * 1000UL + (latency + random(jitter + 1)) * 1000UL;
+  if(txCount && (int32_t)(txLastReady - ready) > 0) ready = txLastReady;
+
+  for(uint16_t x = 0; x < n; x++)
+  {
+    ready += byteMicros;
+
+    if(dropRate && random(100) < dropRate)
+    {
+      txDropped++;
+      continue;
+    }
+
+    if(txCount >= JQ8400_EMULATOR_TX_BUFFER)
+    {
+      // Overflow, just like a real UART
+      txDropped++;
+      continue;
+    }
+
+    uint8_t slot   = (txHead + txCount) % JQ8400_EMULATOR_TX_BUFFER;
+    txBytes[slot]  = frame[x];
+    txReady[slot]  = ready;
+    txCount++;
+  }
+
+  txLastReady = ready;
+}
+
+void JQ8400_Emulator::respondUnsigned(uint8_t command, uint16_t value)
+{
+  uint8_t buf[2] = { (uint8_t)(value >> 8), (uint8_t)(value & 0xFF) };
+  respond(command, buf, 2);
+}
+
+void JQ8400_Emulator::respondTime(uint8_t command, uint16_t seconds)
+{
+  uint8_t buf[3] = { (uint8_t)(seconds / 3600), (uint8_t)((seconds / 60) % 60), (uint8_t)(seconds % 60) };
+  respond(command, buf, 3);
+}
+
+void JQ8400_Emulator::handleCommand()
+{
+  uint8_t  command = rxFrame[1];
+  uint8_t  length  = rxFrame[2];
+  uint8_t *data    = &rxFrame[3];
+  uint16_t arg16   = length >= 2 ? ((uint16_t)data[0] << 8) | data[1] : 0;
+
+  tick();
+
+  switch(command)
+  {
+    case 0x01: // MP3_CMD_STATUS
+    {
+      uint8_t reported = starting ? MP3_STATUS_STOPPED : status;
+      respond(command, &reported, 1);
+      break;
+    }
+
+    case 0x02: // MP3_CMD_PLAY
+      if(status == MP3_STATUS_PAUSED)
+      {
+        status = MP3_STATUS_PLAYING;
+        abEnd  = 0;
+      }
+      else
+      {
+        startFile(currentIndex);
+      }
+      break;
+
+    case 0x03: // MP3_CMD_PAUSE
+      if(status == MP3_STATUS_PLAYING) status = MP3_STATUS_PAUSED;
+      break;
+
+    case 0x04: // MP3_CMD_SLEEP / MP3_CMD_RESET
+    case 0x10: // MP3_CMD_STOP
+      status           = MP3_STATUS_STOPPED;
+      positionMs       = 0;
+      abEnd            = 0;
+      interjectedIndex = 0;
+      playlistLength   = playlistPosition = 0;
+      break;
+
+    case 0x05: // MP3_CMD_PREV
+      startFile(currentIndex > 1 ? currentIndex - 1 : countFiles());
+      break;
+
+    case 0x06: // MP3_CMD_NEXT
+      startFile(currentIndex < countFiles() ? currentIndex + 1 : 1);
+      break;
+
+    case 0x07: // MP3_CMD_PLAY_IDX
+      startFile(arg16);
+      break;
+
+    case 0x08: // MP3_CMD_PLAY_FILE_FOLDER
+      if(length > 1)
+      {
+        uint8_t oldSource = source;
+        source = data[0];
+        uint16_t index = findByPattern((const char *)&data[1], length - 1);
+        if(!index || !startFile(index)) source = oldSource;
+      }
+      break;
+
+    case 0x09: // MP3_CMD_GET_SOURCES
+      respond(command, &sources, 1);
+      break;
+
+    case 0x0A: // MP3_CMD_GET_SOURCE
+      respond(command, &source, 1);
+      break;
+
+    case 0x0B: // MP3_CMD_SOURCE_SET
+      if(length >= 1 && (sources & (1<<data[0])))
+      {
+        source       = data[0];
+        status       = MP3_STATUS_STOPPED;
+        currentIndex = 1;
+        positionMs   = 0;
+      }
+      break;
+
+    case 0x0C: // MP3_CMD_COUNT_FILES
+      respondUnsigned(command, countFiles());
+      break;
+
+    case 0x0D: // MP3_CMD_CURRENT_FILE_IDX
+      respondUnsigned(command, currentIndex);
+      break;
+
+    case 0x0E: // MP3_CMD_PREV_FOLDER
+    case 0x0F: // MP3_CMD_NEXT_FOLDER
+    {
+      uint16_t count;
+      uint16_t first = folderRange(currentIndex, &count);
+      uint16_t total = countFiles();
+      if(!total) break;
+
+      if(command == 0x0F)
+      {
+        startFile(first + count <= total ? first + count : 1);
+      }
+      else
+      {
+        uint16_t prevFirst = folderRange(first > 1 ? first - 1 : total, &count);
+        startFile(prevFirst);
+      }
+      break;
+    }
+
+    case 0x11: // MP3_CMD_FIRST_FILE_IN_FOLDER_IDX
+    {
+      uint16_t count;
+      respondUnsigned(command, folderRange(currentIndex, &count));
+      break;
+    }
+
+    case 0x12: // MP3_CMD_COUNT_IN_FOLDER
+    {
+      uint16_t count;
+      folderRange(currentIndex, &count);
+      respondUnsigned(command, count);
+      break;
+    }
+
+    case 0x13: // MP3_CMD_VOL_SET
+      if(length >= 1) volume = data[0] > 30 ? 30 : data[0];
+      break;
+
+    case 0x14: // MP3_CMD_VOL_UP
+      if(volume < 30) volume++;
+      break;
+
+    case 0x15: // MP3_CMD_VOL_DN
+      if(volume > 0) volume--;
+      break;
+
+    case 0x16: // MP3_CMD_INSERT_IDX
+      if(length >= 3 && data[0] == source)
+      {
+        uint16_t index = ((uint16_t)data[1] << 8) | data[2];
+        if(!fileByIndex(index)) break;
+
+        if(!interjectedIndex && status != MP3_STATUS_STOPPED)
+        {
+          interjectedIndex    = currentIndex;
+          interjectedPosition = positionMs;
+          interjectedStatus   = status;
+        }
+        startFile(index);
+      }
+      break;
+
+    case 0x18: // MP3_CMD_LOOP_SET
+      if(length >= 1) loopMode = data[0];
+      break;
+
+    case 0x1A: // MP3_CMD_EQ_SET
+      if(length >= 1) eq = data[0];
+      break;
+
+    case 0x1B: // MP3_CMD_PLAYLIST
+    {
+      // Pairs of characters naming files in the ZH folder
+      playlistLength = playlistPosition = 0;
+      for(uint8_t x = 0; x + 1 < length && playlistLength < JQ8400_EMULATOR_PLAYLIST; x += 2)
+      {
+        char pattern[] = "/ZH*/00*???";
+        pattern[5] = data[x];
+        pattern[6] = data[x+1];
+        uint16_t index = findByPattern(pattern, sizeof(pattern)-1);
+        if(index) playlist[playlistLength++] = index;
+      }
+
+      if(playlistLength) startFile(playlist[playlistPosition++]);
+      break;
+    }
+
+    case 0x1E: // MP3_CMD_CURRENT_FILE_NAME
+    {
+      // The device reports an 8.3 name, upper case without the dot
+      File *f = fileByIndex(currentIndex);
+      char  name[12];
+      uint8_t n = 0;
+      if(f)
+      {
+        const char *base = strrchr(f->path, '/');
+        base = base ? base + 1 : f->path;
+        for(; *base && n < sizeof(name); base++)
+        {
+          if(*base != '.') name[n++] = toupper(*base);
+        }
+      }
+      respond(command, (uint8_t *)name, n);
+      break;
+    }
+
+    case 0x1F: // MP3_CMD_SEEK_IDX
+      if(fileByIndex(arg16))
+      {
+        currentIndex = arg16;
+        positionMs   = 0;
+        status       = MP3_STATUS_STOPPED;
+      }
+      break;
+
+    case 0x20: // MP3_CMD_AB_PLAY
+      if(length >= 4 && status == MP3_STATUS_PLAYING)
+      {
+        abStart = data[0] * 60 + data[1];
+        abEnd   = data[2] * 60 + data[3];
+        if(abEnd <= abStart) abEnd = 0;
+      }
+      break;
+
+    case 0x21: // MP3_CMD_AB_PLAY_STOP
+      abEnd = 0;
+      break;
+
+    case 0x22: // MP3_CMD_RWND
+      positionMs = positionMs > arg16 * 1000UL ? positionMs - arg16 * 1000UL : 0;
+      break;
+
+    case 0x23: // MP3_CMD_FFWD
+    {
+      File *f = fileByIndex(currentIndex);
+      if(!f) break;
+      positionMs += arg16 * 1000UL;
+      if(positionMs > f->lengthSeconds * 1000UL) positionMs = f->lengthSeconds * 1000UL;
+      break;
+    }
+
+    case 0x24: // MP3_CMD_CURRENT_FILE_LEN
+    {
+      File *f = fileByIndex(currentIndex);
+      respondTime(command, f ? f->lengthSeconds : 0);
+      break;
+    }
+
+    case 0x25: // MP3_CMD_CURRENT_FILE_POS
+      reportPosition = 1;
+      lastReport     = clockMillis();
+      respondTime(command, positionMs / 1000);
+      break;
+
+    case 0x26: // MP3_CMD_CURRENT_FILE_POS_STOP
+      reportPosition = 0;
+      break;
+  }
+}
+
+size_t JQ8400_Emulator::write(uint8_t c)
+{
+  // Wait for the start of a frame
+  if(rxCount == 0 && c != 0xAA) return 1;
+
+  rxFrame[rxCount++] = c;
+
+  // AA CMD LEN [DATA...] SUM
+  if(rxCount < 3) return 1;
+  if(rxFrame[2] > sizeof(rxFrame) - 4)
+  {
+    // Can't be a real frame
+    rxBadFrames++;
+    rxCount = 0;
+    return 1;
+  }
+  if(rxCount < rxFrame[2] + 4) return 1;
+
+  uint8_t sum = 0;
+  for(uint16_t x = 0; x < rxCount - 1; x++) sum += rxFrame[x];
+  rxCount = 0;
+
+  if(sum != rxFrame[rxFrame[2] + 3])
+  {
+    rxBadFrames++;
+    return 1;
+  }
+
+  // Still booting, deaf to the world
+  if((int32_t)(clockMillis() - bootedAt) < 0) return 1;
+
+  rxFrames++;
+  rxLastCommand = rxFrame[1];
+  handleCommand();
+  return 1;
+}
+
+int JQ8400_Emulator::available()
+{
+  tick();
+
+  uint32_t now   = clockMillis() * 1000UL;
+  int      count = 0;
+  while(count < txCount && (int32_t)(now - txReady[(txHead + count) % JQ8400_EMULATOR_TX_BUFFER]) >= 0)
+  {
+    count++;
+  }
+  return count;
+}
+
+int JQ8400_Emulator::read()
+{
+  if(!available()) return -1;
+
+  uint8_t c = txBytes[txHead];
+  txHead    = (txHead + 1) % JQ8400_EMULATOR_TX_BUFFER;
+  txCount--;
+  return c;
+}
+
+int JQ8400_Emulator::peek()
+{
+  if(!available()) return -1;
+  return txBytes[txHead];
+}
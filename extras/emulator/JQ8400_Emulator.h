@@ -0,0 +1,361 @@
+/**
+ * Software model of a JQ8400 MP3 Module, for testing without hardware.
+ *
+ * Copyright (C) 2019 James Sleeman, <http://sparks.gogo.co.nz/jq6500/index.html>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author James Sleeman, http://sparks.gogo.co.nz/
+ * @license MIT License
+ * @file
+ */
+
+#ifndef JQ8400Emulator_h
+#define JQ8400Emulator_h
+
+#include <Arduino.h>
+#include "../../src/JQ8400_Serial.h"
+#include "JQ8400_VirtualClock.h"
+
+// Limits of the emulated media and buffers
+#define JQ8400_EMULATOR_MAX_FILES     64
+#define JQ8400_EMULATOR_PATH_LENGTH   24
+#define JQ8400_EMULATOR_PLAYLIST      127
+#define JQ8400_EMULATOR_TX_BUFFER     128
+#define JQ8400_EMULATOR_RX_BUFFER     259
+
+/** Emulates a JQ8400 module on the other end of a Stream.
+ *
+ * This is intended for host (eg Linux) builds of your code and the library
+ * using an Arduino compatible core (EpoxyDuino, ArduinoFake or your own
+ * `Arduino.h`, as the tests in extras/test do), it is not part of the 
+ * library proper and is not compiled into sketches.
+ *
+ * Give the emulator to JQ8400_Serial in place of the real serial port, it
+ * parses the command frames written to it, keeps the player state (files,
+ * folders, sources, volume, status, position...) and responds with correctly
+ * checksummed frames.  Response latency, jitter, dropped bytes and corrupted
+ * checksums can be configured to see how your code copes.
+ *
+ * **Example**
+ *
+ *     #include "extras/emulator/JQ8400_Emulator.h"
+ *
+ *     JQ8400_Emulator device;
+ *     JQ8400_Serial   mp3(device);
+ *
+ *     device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 180);
+ *     device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 200);
+ *     device.setLatency(5, 2);
+ *     device.setCorruptRate(10);
+ *
+ *     mp3.playFileByIndexNumber(2);
+ *     assert(mp3.getStatus() == MP3_STATUS_PLAYING);
+ *
+ * Time is taken from millis() (or see setTimeSource()), the position of the
+ * playing file advances with it, and bytes are made available at the rate of
+ * the configured baud.
+ *
+ * To run without waiting in real time, give both the emulator and
+ * JQ8400_Serial a JQ8400_VirtualClock...
+ *
+ *     mp3.setTimeSource(JQ8400_VirtualClock::millis, JQ8400_VirtualClock::delay);
+ *     device.setTimeSource(JQ8400_VirtualClock::millis);
+ *
+ */
+
+class JQ8400_Emulator : public Stream
+{
+  public:
+
+    JQ8400_Emulator();
+
+    /** @name Media
+     *
+     */
+    ///@{
+
+    /** Add a file to the end of the "FAT" of a source.
+     *
+     *  Files are given index numbers (per source) in the order added, the
+     *  first path component is the folder.  The source becomes available.
+     *
+     *  @param source        MP3_SRC_SDCARD etc
+     *  @param path          Path of the file, eg "/01/002.mp3"
+     *  @param lengthSeconds Length of the audio
+     *  @return Index number of the file on that source, or 0 if full.
+     */
+
+    uint16_t addFile(uint8_t source, const char *path, uint16_t lengthSeconds);
+
+    /** Remove all files from all sources, and make all sources unavailable. */
+
+    void clearFiles();
+
+    /** Set if a source is available (eg, an SD Card is inserted).
+     *
+     * @param source    MP3_SRC_SDCARD etc
+     * @param available True or False
+     */
+
+    void setSourceAvailable(uint8_t source, uint8_t available);
+
+    ///@}
+
+    /** @name Faults and Timing
+     *
+     */
+    ///@{
+
+    /** Use a different time source than millis()
+     *
+     * @param millisFunction Function returning milliseconds, or NULL for millis()
+     */
+
+    void setTimeSource(MP3MillisFunction millisFunction) { _millis = millisFunction; lastTick = clockMillis(); }
+
+    /** Set the time between receiving a command and starting the response.
+     *
+     * @param latencyMs Milliseconds before the response begins.
+     * @param jitterMs  Up to this many milliseconds are randomly added.
+     */
+
+    void setLatency(uint16_t latencyMs, uint16_t jitterMs = 0) { latency = latencyMs; jitter = jitterMs; }
+
+    /** Set the time between a file being played and it being heard (and 
+     *  the status being reported as playing).
+     * 
+     * @param delayMs  Milliseconds to start playing.
+     * @param jitterMs Up to this many milliseconds are randomly added.
+     */
+
+    void setStartDelay(uint16_t delayMs, uint16_t jitterMs = 0) { startDelay = delayMs; startJitter = jitterMs; }
+
+    /** Pretend the device has just been powered on, commands are ignored 
+     *  until it has finished booting.
+     * 
+     * @param bootMs Milliseconds from now until the device answers.
+     */
+
+    void powerOn(uint16_t bootMs) { bootedAt = clockMillis() + bootMs; }
+
+    /** Set the baud rate, this sets the rate bytes of a response become available.
+     *
+     * @param baud Default 9600, zero makes the whole response available at once.
+     */
+
+    void setBaudRate(uint32_t baud) { byteMicros = baud ? 10000000UL / baud : 0; }
+
+    /** Randomly drop bytes we send.
+     *
+     * @param percent Percentage chance of each byte being lost.
+     */
+
+    void setDropRate(uint8_t percent) { dropRate = percent; }
+
+    /** Randomly corrupt the checksum of responses.
+     *
+     * @param percent Percentage chance of each frame having a bad checksum.
+     */
+
+    void setCorruptRate(uint8_t percent) { corruptRate = percent; }
+
+    /** Seed the random number generator used for jitter, drops, corruption and random play.
+     *
+     * @param seed Any non zero number.
+     */
+
+    void setSeed(uint32_t seed) { randomState = seed ? seed : 1; }
+
+    ///@}
+
+    /** @name Inspection
+     *
+     *  Read the emulated state directly, without going through the serial protocol.
+     */
+    ///@{
+
+    uint8_t  getStatus()                    { tick(); return starting ? MP3_STATUS_STOPPED : status; }
+    uint8_t  getVolume()                    { return volume;             }
+    uint8_t  getEqualizer()                 { return eq;                 }
+    uint8_t  getLoopMode()                  { return loopMode;           }
+    uint8_t  getSource()                    { return source;             }
+    uint16_t currentFileIndexNumber()       { tick(); return currentIndex; }
+    uint16_t currentFilePositionInSeconds() { tick(); return positionMs / 1000; }
+
+    uint32_t framesReceived()    { return rxFrames;    } ///< Number of good command frames received
+    uint32_t badFramesReceived() { return rxBadFrames; } ///< Number of command frames received with a bad checksum
+    uint32_t framesSent()        { return txFrames;    } ///< Number of response frames sent (including corrupted ones)
+    uint32_t bytesDropped()      { return txDropped;   } ///< Number of response bytes dropped
+    uint8_t  lastCommand()       { return rxLastCommand; } ///< The command byte of the last good frame received
+    uint8_t  busyPin()           { tick(); return (!starting && status == MP3_STATUS_PLAYING) ? HIGH : LOW; } ///< Level of the BUSY output, HIGH while playing
+
+    ///@}
+
+    /** @name Stream Interface
+     *
+     */
+    ///@{
+
+    virtual int    available();
+    virtual int    read();
+    virtual int    peek();
+    virtual void   flush() { }
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+    ///@}
+
+  protected:
+
+    /** A file on the emulated media. */
+
+    struct File
+    {
+      uint8_t  source;                              ///< Which source the file is on
+      uint16_t lengthSeconds;                       ///< Length of the audio
+      char     path[JQ8400_EMULATOR_PATH_LENGTH];   ///< Full path, eg "/01/002.mp3"
+    };
+
+    /** Advance the playing file to the current time, handling end of file. */
+
+    void     tick();
+
+    /** Handle a command frame received in rxFrame.  */
+
+    void     handleCommand();
+
+    /** Queue a response frame to be sent after the configured latency.
+     *
+     * @param command Command byte
+     * @param data    Data bytes
+     * @param length  Number of data bytes
+     */
+
+    void     respond(uint8_t command, const uint8_t *data, uint8_t length);
+
+    /** Respond with a 16 bit integer. */
+
+    void     respondUnsigned(uint8_t command, uint16_t value);
+
+    /** Respond with hours, minutes, seconds. */
+
+    void     respondTime(uint8_t command, uint16_t seconds);
+
+    /** Start playing a file.
+     *
+     * @param index Index of the file on the current source.
+     * @return False if no such file.
+     */
+
+    uint8_t  startFile(uint16_t index);
+
+    /** Called when the playing file reaches its end. */
+
+    void     endOfFile();
+
+    /** Get a file by index on the current source (or NULL) */
+
+    File    *fileByIndex(uint16_t index);
+
+    /** Number of files on the current source */
+
+    uint16_t countFiles();
+
+    /** Return the length of the first path component (the folder name) of the file, or 0 if in the root.  */
+
+    uint8_t  folderOf(File *f, const char **name);
+
+    /** Find the first index (on current source) in the same folder as the given index, and count them.  */
+
+    uint16_t folderRange(uint16_t index, uint16_t *count);
+
+    /** Find a file on the current source matching a JQ8400 wildcard path, eg "/03*\/006*???"
+     *
+     * @return Index number or 0 if not found
+     */
+
+    uint16_t findByPattern(const char *pattern, uint8_t length);
+
+    /** Milliseconds from the time source, see setTimeSource() */
+
+    unsigned long clockMillis() { return _millis ? _millis() : millis(); }
+
+    /** Random number from 0 to limit-1 */
+
+    uint32_t random(uint32_t limit);
+
+    MP3MillisFunction _millis = 0;      ///< Replacement for millis() or NULL
+
+    File     files[JQ8400_EMULATOR_MAX_FILES];
+    uint8_t  fileCount     = 0;
+    uint8_t  sources       = 0;         ///< Bitmask of available sources
+
+    uint8_t  source        = MP3_SRC_SDCARD;
+    uint8_t  status        = MP3_STATUS_STOPPED;
+    uint8_t  volume        = 20;
+    uint8_t  eq            = MP3_EQ_NORMAL;
+    uint8_t  loopMode      = MP3_LOOP_NONE;
+    uint16_t currentIndex  = 1;
+    uint32_t positionMs    = 0;         ///< Position in the current file
+    uint32_t lastTick      = 0;         ///< clockMillis() at last tick()
+    uint8_t  starting      = 0;         ///< True while the file is being opened, see setStartDelay()
+    uint32_t startingUntil = 0;         ///< clockMillis() at which the file is heard
+
+    uint16_t abStart       = 0;         ///< A-B loop start second
+    uint16_t abEnd         = 0;         ///< A-B loop end second, 0 if none
+
+    uint16_t interjectedIndex    = 0;   ///< File to resume after an interjection (0 if none)
+    uint32_t interjectedPosition = 0;   ///< Position to resume after an interjection
+    uint8_t  interjectedStatus   = 0;   ///< Status to resume after an interjection
+
+    uint16_t playlist[JQ8400_EMULATOR_PLAYLIST]; ///< Files remaining from a playlist command
+    uint8_t  playlistLength   = 0;
+    uint8_t  playlistPosition = 0;
+
+    uint8_t  reportPosition = 0;        ///< Reporting the position every second (MP3_CMD_CURRENT_FILE_POS)
+    uint32_t lastReport     = 0;        ///< clockMillis() of the last position report
+
+    uint16_t latency      = 2;
+    uint16_t jitter       = 0;
+    uint16_t startDelay   = 0;
+    uint16_t startJitter  = 0;
+    uint32_t bootedAt     = 0;          ///< clockMillis() when commands are answered, see powerOn()
+    uint32_t byteMicros   = 1041;       ///< 9600 baud
+    uint8_t  dropRate     = 0;
+    uint8_t  corruptRate  = 0;
+    uint32_t randomState  = 1;
+
+    uint8_t  rxFrame[JQ8400_EMULATOR_RX_BUFFER];  ///< Command frame being received
+    uint16_t rxCount        = 0;
+
+    uint8_t  txBytes[JQ8400_EMULATOR_TX_BUFFER];  ///< Ring of response bytes
+    uint32_t txReady[JQ8400_EMULATOR_TX_BUFFER];  ///< micros() at which each byte becomes available
+    uint8_t  txHead         = 0;
+    uint8_t  txCount        = 0;
+    uint32_t txLastReady    = 0;
+
+    uint32_t rxFrames       = 0;
+    uint32_t rxBadFrames    = 0;
+    uint8_t  rxLastCommand  = 0;
+    uint32_t txFrames       = 0;
+    uint32_t txDropped      = 0;
+};
+
+#endif
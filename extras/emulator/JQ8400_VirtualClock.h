@@ -0,0 +1,75 @@
+/**
+ * Simulated clock for testing JQ8400_Serial without waiting in real time.
+ *
+ * Copyright (C) 2019 James Sleeman, <http://sparks.gogo.co.nz/jq6500/index.html>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author James Sleeman, http://sparks.gogo.co.nz/
+ * @license MIT License
+ * @file
+ */
+
+#ifndef JQ8400VirtualClock_h
+#define JQ8400VirtualClock_h
+
+/** A clock which only moves when delay() (or advance()) is called.
+ *
+ * Give it to JQ8400_Serial::setTimeSource() and JQ8400_Emulator::setTimeSource()
+ * and a one second timeout costs nothing but a thousand loop iterations.
+ *
+ * There is only one virtual clock, shared by everybody using it.
+ *
+ */
+
+class JQ8400_VirtualClock
+{
+  public:
+
+    /** Current simulated time in milliseconds. */
+
+    static unsigned long millis() { return now(); }
+
+    /** "Wait" by moving the simulated time forward.
+     *
+     * @param ms Milliseconds
+     */
+
+    static void delay(unsigned long ms) { now() += ms; }
+
+    /** Move the simulated time forward (same as delay()).
+     *
+     * @param ms Milliseconds
+     */
+
+    static void advance(unsigned long ms) { now() += ms; }
+
+    /** Set the simulated time.
+     *
+     * @param ms Milliseconds
+     */
+
+    static void set(unsigned long ms) { now() = ms; }
+
+  protected:
+
+    static unsigned long &now() { static unsigned long ms = 0; return ms; }
+};
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * Host implementation of the Arduino functions declared in Arduino.h
+ *
+ * @file
+ */
+
+#include "Arduino.h"
+
+HostSerial Serial;
+
+static unsigned long hostMillis = 0;
+static uint8_t       hostPins[256];
+
+unsigned long millis()                        { return hostMillis++; }
+unsigned long micros()                        { return hostMillis * 1000; }
+void          delay(unsigned long ms)         { hostMillis += ms; }
+void          yield()                         { }
+int           digitalRead(uint8_t pin)        { return hostPins[pin]; }
+void          digitalWrite(uint8_t pin, uint8_t level) { hostPins[pin] = level; }
+void          pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+
+char *itoa(int value, char *buffer, int radix)
+{
+  sprintf(buffer, radix == 16 ? "%x" : "%d", value);
+  return buffer;
+}
@@ -0,0 +1,95 @@
+/**
+ * Just enough of the Arduino core to build the library and the emulator on
+ * a host (eg Linux) for the tests in this directory, see the Makefile.
+ *
+ * Time from millis() moves on by 1ms each time it is asked, so code which
+ * waits on it without a time source set can't hang, the tests themselves 
+ * mostly give the library and the emulator a JQ8400_VirtualClock.
+ *
+ * @file
+ */
+
+#ifndef JQ8400TestArduino_h
+#define JQ8400TestArduino_h
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HEX 16
+#define DEC 10
+
+#define HIGH 1
+#define LOW  0
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+#define F(x) x
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define memcpy_P         memcpy
+
+unsigned long millis();
+unsigned long micros();
+void          delay(unsigned long ms);
+void          yield();
+int           digitalRead(uint8_t pin);
+void          digitalWrite(uint8_t pin, uint8_t level);
+void          pinMode(uint8_t pin, uint8_t mode);
+char         *itoa(int value, char *buffer, int radix);
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t length)
+    {
+      size_t n = 0;
+      while(length--) n += this->write(*buffer++);
+      return n;
+    }
+    
+    size_t print(const char *s)                       { return this->write((const uint8_t *)s, strlen(s)); }
+    size_t print(char c)                              { return this->write((uint8_t)c); }
+    size_t print(int v, int base = DEC)               { return this->print((long)v, base); }
+    size_t print(unsigned v, int base = DEC)          { return this->print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC)              { char s[24]; snprintf(s, sizeof(s), base == HEX ? "%lX" : "%ld", v); return this->print(s); }
+    size_t print(unsigned long v, int base = DEC)     { char s[24]; snprintf(s, sizeof(s), base == HEX ? "%lX" : "%lu", v); return this->print(s); }
+    size_t println()                                  { return this->print('\n'); }
+    template<typename T> size_t println(T v)          { return this->print(v) + this->println(); }
+    template<typename T> size_t println(T v, int base){ return this->print(v, base) + this->println(); }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int  available() = 0;
+    virtual int  read()      = 0;
+    virtual int  peek()      = 0;
+    virtual void flush()     {}
+};
+
+/** Serial goes to stdout and never has anything to read. */
+
+class HostSerial : public Stream
+{
+  public:
+    size_t write(uint8_t c) { putchar(c); return 1; }
+    using Print::write;
+    int available() { return 0;  }
+    int read()      { return -1; }
+    int peek()      { return -1; }
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * Minimal checks for the host tests, each test is a program which returns
+ * non zero if any check failed.
+ *
+ * @file
+ */
+
+#ifndef JQ8400Test_h
+#define JQ8400Test_h
+
+#include <Arduino.h>
+#include "../../src/JQ8400_Serial.h"
+#include "../emulator/JQ8400_Emulator.h"
+
+typedef JQ8400_VirtualClock VirtualClock;
+
+static int testChecks   = 0;
+static int testFailures = 0;
+
+#define CHECK(condition) \
+  do { testChecks++; if(!(condition)) { testFailures++; printf("%s:%d: FAILED %s\n", __FILE__, __LINE__, #condition); } } while(0)
+
+#define CHECK_EQUAL(actual, expected) \
+  do { testChecks++; long a_ = (long)(actual), e_ = (long)(expected); if(a_ != e_) { testFailures++; printf("%s:%d: FAILED %s == %s (%ld != %ld)\n", __FILE__, __LINE__, #actual, #expected, a_, e_); } } while(0)
+
+#define CHECK_BETWEEN(actual, low, high) \
+  do { testChecks++; long a_ = (long)(actual); if(a_ < (long)(low) || a_ > (long)(high)) { testFailures++; printf("%s:%d: FAILED %s in %s..%s (%ld)\n", __FILE__, __LINE__, #actual, #low, #high, a_); } } while(0)
+
+/** Print the outcome, for main() to return */
+
+static int testResult(const char *name)
+{
+  printf("%s: %d checks, %d failed\n", name, testChecks, testFailures);
+  return testFailures ? 1 : 0;
+}
+
+/** Connect a module to an emulator, both on the virtual clock */
+
+static inline void testConnect(JQ8400_Serial &mp3, JQ8400_Emulator &device)
+{
+  mp3.setTimeSource(VirtualClock::millis, VirtualClock::delay);
+  device.setTimeSource(VirtualClock::millis);
+}
+
+/** A Stream which plays the device from a script: what is written to it is
+ *  kept in sent[], and bytes given to reply() can be read once the next
+ *  whole frame has been written (so they are not taken for line garbage), 
+ *  or with replyFrame() the next frame of the same command.
+ */
+
+class TestStream : public Stream
+{
+  public:
+    uint8_t  sent[256];          ///< Everything written, up to 256 bytes
+    uint16_t sentLength   = 0;   ///< Number of bytes in sent[]
+    uint16_t writes       = 0;   ///< Number of write() calls
+
+    /** Bytes to answer the next frame with */
+
+    void reply(const uint8_t *bytes, uint8_t length)
+    {
+      for(uint8_t x = 0; x < length && pendingLength < sizeof(pending); x++) pending[pendingLength++] = bytes[x];
+    }
+
+    /** A frame to answer the next frame of the same command with, the checksum is added */
+
+    void replyFrame(uint8_t command, const uint8_t *data, uint8_t length)
+    {
+      pendingCommand = command;
+      uint8_t head[3] = { 0xAA, command, length };
+      uint8_t sum     = 0xAA + command + length;
+      for(uint8_t x = 0; x < length; x++) sum += data[x];
+      reply(head, 3);
+      reply(data, length);
+      reply(&sum, 1);
+    }
+
+    size_t write(uint8_t c)
+    {
+      writes++;
+      put(c);
+      return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t length)
+    {
+      writes++;
+      for(size_t x = 0; x < length; x++) put(buffer[x]);
+      return length;
+    }
+
+    int available() { return rxLength - rxIndex; }
+    int read()      { return rxIndex < rxLength ? rx[rxIndex++] : -1; }
+    int peek()      { return rxIndex < rxLength ? rx[rxIndex]   : -1; }
+
+  protected:
+    uint8_t  pending[64];
+    uint8_t  pendingLength = 0;
+    uint8_t  pendingCommand = 0;
+    uint8_t  rx[256];
+    uint16_t rxLength      = 0;
+    uint16_t rxIndex       = 0;
+    uint16_t frameStart    = 0;
+
+    void put(uint8_t c)
+    {
+      if(sentLength >= sizeof(sent)) return;
+      sent[sentLength++] = c;
+
+      // At the end of a frame, the reply becomes readable
+      uint16_t length = sentLength - frameStart;
+      if(length >= 4 && length == sent[frameStart+2] + 4)
+      {
+        if(!pendingCommand || pendingCommand == sent[frameStart+1])
+        {
+          for(uint8_t x = 0; x < pendingLength && rxLength < sizeof(rx); x++) rx[rxLength++] = pending[x];
+          pendingLength  = 0;
+          pendingCommand = 0;
+        }
+        frameStart = sentLength;
+      }
+    }
+};
+
+#endif
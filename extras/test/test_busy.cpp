@@ -0,0 +1,75 @@
+/**
+ * The BUSY pin: read instead of asking the device, and the end of a file
+ * reported to onFinished() (but not the changes we make ourselves, and
+ * whatever queries we send).
+ */
+
+#include "test.h"
+
+static JQ8400_Emulator *busyDevice = 0;
+static uint8_t          finished   = 0;
+
+static int  readBusy(uint8_t pin)           { (void)pin; return busyDevice->busyPin(); }
+static void onFinished(JQ8400_Serial &mp3) { (void)mp3; finished++; }
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 3);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 3);
+  device.setLatency(5);
+  busyDevice = &device;
+  
+  mp3.setLoopMode(MP3_LOOP_NONE);
+  mp3.setBusyPin(7, HIGH, readBusy);
+  mp3.onFinished(onFinished);
+  
+  // Busy while playing, without asking the device
+  mp3.playFileByIndexNumber(1);
+  uint32_t frames = device.framesReceived();
+  CHECK(mp3.busy());
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_PLAYING);
+  CHECK_EQUAL(device.framesReceived() - frames, 0);
+  
+  // Not busy once it has finished, then the device is asked
+  VirtualClock::delay(3100);
+  CHECK(!mp3.busy());
+  CHECK_EQUAL(finished, 1);
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_STOPPED);
+  CHECK_EQUAL(device.framesReceived() - frames, 1);
+  
+  // Pausing is our doing, not the end of the file
+  mp3.playFileByIndexNumber(2);
+  VirtualClock::delay(500);
+  mp3.pause();
+  for(uint8_t x = 0; x < 100; x++)
+  {
+    mp3.update();
+    VirtualClock::delay(1);
+  }
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_PAUSED);
+  CHECK_EQUAL(finished, 1);
+  
+  // But the end of the file after resuming is
+  mp3.play();
+  for(uint16_t x = 0; x < 4000; x++)
+  {
+    mp3.update();
+    VirtualClock::delay(1);
+  }
+  CHECK_EQUAL(finished, 2);
+  
+  // Queries polled up to the end of a file don't hide it
+  mp3.playFileByIndexNumber(1);
+  for(uint8_t x = 0; x < 40; x++)
+  {
+    mp3.currentFileIndexNumber();
+    mp3.update();
+    VirtualClock::delay(100);
+  }
+  CHECK_EQUAL(finished, 3);
+  
+  return testResult("test_busy");
+}
@@ -0,0 +1,118 @@
+/**
+ * The query cache: answers are reused for their time, or until a command
+ * changes them.
+ */
+
+#include "test.h"
+
+#if MP3_CACHE
+/** Answers each status query (0x01) with the next of the given frames */
+
+class StatusScript : public TestStream
+{
+  public:
+    const uint8_t (*answers)[5] = 0;
+    uint8_t         count       = 0;
+    
+    size_t write(const uint8_t *buffer, size_t length)
+    {
+      if(length >= 2 && buffer[1] == 0x01 && count)
+      {
+        reply(*answers++, 5);
+        count--;
+      }
+      return TestStream::write(buffer, length);
+    }
+};
+#endif
+
+int main()
+{
+#if MP3_CACHE
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 100);
+  
+  // Not cached until a time is set
+  uint32_t frames = device.framesReceived();
+  mp3.countFiles();
+  mp3.countFiles();
+  CHECK_EQUAL(device.framesReceived() - frames, 2);
+  
+  // Then asked once in that time
+  mp3.setCacheTime(MP3_CACHE_COUNT_FILES, 1000);
+  mp3.setCacheTime(MP3_CACHE_STATUS, 1000);
+  mp3.setCacheTime(MP3_CACHE_FILE_INDEX, 1000);
+  frames = device.framesReceived();
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(device.framesReceived() - frames, 1);
+  CHECK_EQUAL(mp3.cacheHits(MP3_CACHE_COUNT_FILES), 2);
+  CHECK_EQUAL(mp3.cacheMisses(MP3_CACHE_COUNT_FILES), 1);
+  
+  // And again once it is too old
+  VirtualClock::advance(1000);
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(device.framesReceived() - frames, 2);
+  
+  // A command forgets what it changes, and only that
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_STOPPED);
+  frames = device.framesReceived();
+  mp3.playFileByIndexNumber(2);
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_PLAYING);
+  CHECK_EQUAL(mp3.currentFileIndexNumber(), 2);
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(device.framesReceived() - frames, 3);
+  
+  mp3.stop();
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_STOPPED);
+  CHECK_EQUAL(device.framesReceived() - frames, 5);
+  
+  // A reset forgets everything
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(mp3.cacheMisses(MP3_CACHE_COUNT_FILES), 2);
+  mp3.reset();
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(mp3.cacheMisses(MP3_CACHE_COUNT_FILES), 3);
+  
+  // Failed answers are not kept
+  mp3.clearCache();
+  device.setDropRate(100);
+  CHECK_EQUAL(mp3.countFiles(), 0);
+  device.setDropRate(0);
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  
+  // Nor a status which the vote on a noisy line did not agree with
+  {
+    const uint8_t answers[][5] = {
+      { 0xAA, 0x01, 0x01, 0x01, 0x00 },  // Corrupted
+      { 0xAA, 0x01, 0x01, 0x01, 0xAD },  // Playing
+      { 0xAA, 0x01, 0x01, 0x00, 0xAC },  // Stopped
+      { 0xAA, 0x01, 0x01, 0x01, 0xAD },
+      { 0xAA, 0x01, 0x01, 0x00, 0xAC },
+      { 0xAA, 0x01, 0x01, 0x01, 0xAD },
+    };
+    StatusScript  script;
+    JQ8400_Serial other(script);
+    script.answers = answers;
+    script.count   = 6;
+    other.setRetries(1);
+    other.setCacheTime(MP3_CACHE_STATUS, 1000);
+    
+    CHECK_EQUAL(other.getStatus(), 0);
+    CHECK_EQUAL(other.lastResult(), MP3_RESULT_CHECKSUM);
+    CHECK_EQUAL(script.count, 0);
+    
+    // So it is asked again
+    uint16_t writes = script.writes;
+    other.setRetries(0);
+    other.getStatus();
+    CHECK_EQUAL(script.writes - writes, 1);
+  }
+#endif
+  
+  return testResult("test_cache");
+}
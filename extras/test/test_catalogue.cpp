@@ -0,0 +1,70 @@
+/**
+ * The file catalogue: building it from the device, finding and playing
+ * files by name, saving it and loading it back while the media is unchanged.
+ */
+
+#include "test.h"
+
+static uint8_t  store[512];
+static uint16_t storeWrites = 0;
+
+static void    storeWrite(uint16_t address, uint8_t value) { store[address] = value; storeWrites++; }
+static uint8_t storeRead(uint16_t address)                 { return store[address]; }
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  
+  const char *paths[] = { "/01/zeta.mp3", "/01/002.mp3", "/02/alpha.mp3", "/03/hello.mp3", "/03/b.mp3", "/03/c.mp3" };
+  for(uint8_t x = 0; x < 6; x++) device.addFile(MP3_SRC_SDCARD, paths[x], 100);
+  
+  // Nothing found before there is a catalogue
+  CHECK_EQUAL(mp3.fileIndexByName("hello.mp3"), 0);
+  CHECK(!mp3.playFileByName("hello.mp3"));
+  
+  MP3CatalogueEntry files[10];
+  CHECK_EQUAL(mp3.buildCatalogue(files, 10), 6);
+  for(uint8_t x = 0; x < 6; x++) CHECK_EQUAL(mp3.fileIndexByName(paths[x]), x + 1);
+  CHECK_EQUAL(mp3.fileIndexByName("nope.mp3"), 0);
+  
+  // Case does not matter, and playing is a single frame
+  uint32_t frames = device.framesReceived();
+  CHECK(mp3.playFileByName("HELLO.mp3"));
+  CHECK_EQUAL(device.framesReceived() - frames, 1);
+  CHECK_EQUAL(device.currentFileIndexNumber(), 4);
+  
+  // Saved with a header, and loaded back without asking the names again
+  CHECK_EQUAL(mp3.saveCatalogue(storeWrite, 10), 8 + 4 * 6);
+  CHECK_EQUAL(storeWrites, 8 + 4 * 6);
+  
+  MP3CatalogueEntry loaded[10];
+  mp3.clearCatalogue();
+  frames = device.framesReceived();
+  CHECK_EQUAL(mp3.loadCatalogue(loaded, 10, storeRead, 10), 6);
+  CHECK_BETWEEN(device.framesReceived() - frames, 1, 2);
+  CHECK_EQUAL(mp3.fileIndexByName("b.mp3"), 5);
+  
+  // Too small a table, or different media, and the saved one is no good
+  CHECK_EQUAL(mp3.loadCatalogue(loaded, 5, storeRead, 10), 0);
+  device.addFile(MP3_SRC_SDCARD, "/04/x.mp3", 1);
+  CHECK_EQUAL(mp3.loadCatalogue(loaded, 10, storeRead, 10), 0);
+  
+  // Names with the same hash are only told apart by seeking, if allowed
+  JQ8400_Emulator other;
+  JQ8400_Serial   mp3b(other);
+  testConnect(mp3b, other);
+  other.addFile(MP3_SRC_SDCARD, "/01/00420.mp3", 100);
+  other.addFile(MP3_SRC_SDCARD, "/01/00466.mp3", 100);
+  CHECK_EQUAL(mp3b.buildCatalogue(files, 10), 2);
+  
+  frames = other.framesReceived();
+  CHECK_EQUAL(mp3b.fileIndexByName("00466.mp3"), 0);
+  CHECK_EQUAL(other.framesReceived() - frames, 0);
+  CHECK_EQUAL(mp3b.fileIndexByName("00466.mp3", 1), 2);
+  CHECK(mp3b.playFileByName("00420.mp3"));
+  CHECK_EQUAL(other.currentFileIndexNumber(), 1);
+  
+  return testResult("test_catalogue");
+}
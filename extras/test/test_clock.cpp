@@ -0,0 +1,46 @@
+/**
+ * An injected time source: waiting for the device costs simulated time 
+ * only, and the emulator plays on the same clock.
+ */
+
+#include "test.h"
+
+static unsigned long delayed = 0;
+
+static void countingDelay(unsigned long ms)
+{
+  delayed += ms;
+  VirtualClock::delay(ms);
+}
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 2);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 2);
+  device.setLatency(20, 0);
+  
+  // The answer takes the emulator's latency, on the virtual clock
+  unsigned long start = VirtualClock::millis();
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_BETWEEN(VirtualClock::millis() - start, 20, 40);
+  
+  // A lost answer costs the whole timeout, waited for through the delay function
+  mp3.setTimeSource(VirtualClock::millis, countingDelay);
+  device.setDropRate(100);
+  start = VirtualClock::millis();
+  CHECK_EQUAL(mp3.countFiles(), 0);
+  CHECK_BETWEEN(VirtualClock::millis() - start, 1000, 1010);
+  CHECK_BETWEEN(delayed, 1000, 1010);
+  device.setDropRate(0);
+  
+  // Files play on the same clock
+  mp3.setLoopMode(MP3_LOOP_ALL);
+  mp3.playFileByIndexNumber(1);
+  VirtualClock::advance(2500);
+  CHECK_EQUAL(mp3.currentFileIndexNumber(), 2);
+  
+  return testResult("test_clock");
+}
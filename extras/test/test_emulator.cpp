@@ -0,0 +1,92 @@
+/**
+ * The emulator itself: answering queries, playback, looping and the end of
+ * files.
+ */
+
+#include "test.h"
+
+int main()
+{
+  // Queries are answered from the file table and the player state
+  {
+    JQ8400_Emulator device;
+    JQ8400_Serial   mp3(device);
+    device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 30);
+    device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 40);
+    device.addFile(MP3_SRC_SDCARD, "/02/001.mp3", 50);
+    
+    CHECK_EQUAL(mp3.countFiles(), 3);
+    CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_STOPPED);
+    
+    mp3.setVolume(12);
+    CHECK_EQUAL(device.getVolume(), 12);
+    
+    mp3.playFileByIndexNumber(2);
+    CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_PLAYING);
+    CHECK_EQUAL(mp3.currentFileIndexNumber(), 2);
+    CHECK_EQUAL(mp3.currentFileLengthInSeconds(), 40);
+    CHECK_EQUAL(device.framesReceived(), 7);
+    CHECK_EQUAL(device.badFramesReceived(), 0);
+  }
+  
+  // A file plays for its length and then the device stops
+  {
+    JQ8400_Emulator device;
+    JQ8400_Serial   mp3(device);
+    device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 3);
+    
+    mp3.setLoopMode(MP3_LOOP_NONE);
+    mp3.playFileByIndexNumber(1);
+    delay(2000);
+    CHECK_EQUAL(device.getStatus(), MP3_STATUS_PLAYING);
+    CHECK_EQUAL(device.currentFilePositionInSeconds(), 2);
+    delay(1500);
+    CHECK_EQUAL(device.getStatus(), MP3_STATUS_STOPPED);
+  }
+  
+  // Playing to the end moves on to the next file
+  {
+    JQ8400_Emulator device;
+    JQ8400_Serial   mp3(device);
+    device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 2);
+    device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 2);
+    
+    mp3.setLoopMode(MP3_LOOP_ALL);
+    mp3.playFileByIndexNumber(1);
+    delay(2500);
+    CHECK_EQUAL(device.currentFileIndexNumber(), 2);
+    CHECK_EQUAL(mp3.currentFileIndexNumber(), 2);
+  }
+  
+  // A 0 second clip looped on its own must not hang the emulator
+  {
+    JQ8400_Emulator device;
+    JQ8400_Serial   mp3(device);
+    device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 0);
+    
+    mp3.setLoopMode(MP3_LOOP_ONE);
+    mp3.playFileByIndexNumber(1);
+    delay(5000);
+    CHECK_EQUAL(device.getStatus(), MP3_STATUS_PLAYING);
+    CHECK_EQUAL(device.currentFileIndexNumber(), 1);
+  }
+  
+  // Nor looping a folder of them
+  {
+    JQ8400_Emulator device;
+    JQ8400_Serial   mp3(device);
+    device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 0);
+    device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 0);
+    
+    mp3.setLoopMode(MP3_LOOP_ALL);
+    mp3.playFileByIndexNumber(1);
+    delay(5000);
+    CHECK_EQUAL(device.getStatus(), MP3_STATUS_PLAYING);
+    
+    mp3.setLoopMode(MP3_LOOP_FOLDER);
+    delay(5000);
+    CHECK_EQUAL(device.getStatus(), MP3_STATUS_PLAYING);
+  }
+  
+  return testResult("test_emulator");
+}
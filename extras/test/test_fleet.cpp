@@ -0,0 +1,82 @@
+/**
+ * A fleet of modules: asked together they answer in about the time one 
+ * takes, each with its own answer, timeout and statistics, and started 
+ * together they start within a few ms of each other.
+ */
+
+#include "test.h"
+#include "../../src/JQ8400_Fleet.h"
+
+int main()
+{
+  JQ8400_Emulator device[4];
+  JQ8400_Serial   mp3[4] = { JQ8400_Serial(device[0]), JQ8400_Serial(device[1]), JQ8400_Serial(device[2]), JQ8400_Serial(device[3]) };
+  JQ8400_Fleet    fleet;
+  
+  for(uint8_t x = 0; x < 4; x++)
+  {
+    testConnect(mp3[x], device[x]);
+    device[x].setLatency(20 + x * 5);
+    for(uint8_t f = 0; f <= x; f++) device[x].addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+    CHECK(fleet.add(mp3[x]));
+  }
+  CHECK_EQUAL(fleet.size(), 4);
+  
+  // One after the other takes a round trip each
+  uint32_t start = VirtualClock::millis();
+  for(uint8_t x = 0; x < 4; x++) CHECK_EQUAL(mp3[x].countFiles(), x + 1);
+  uint32_t sequential = VirtualClock::millis() - start;
+  
+  // Together takes about as long as the slowest
+  uint16_t counts[4];
+  start = VirtualClock::millis();
+  CHECK_EQUAL(fleet.countFiles(counts), 4);
+  uint32_t together = VirtualClock::millis() - start;
+  for(uint8_t x = 0; x < 4; x++) CHECK_EQUAL(counts[x], x + 1);
+  CHECK_BETWEEN(together, 35, 60);
+  CHECK(together * 2 < sequential);
+  
+  // Commands go to everybody
+  fleet.playFileByIndexNumber(1);
+  fleet.setVolume(7);
+  uint8_t statuses[4];
+  CHECK_EQUAL(fleet.getStatus(statuses), 4);
+  for(uint8_t x = 0; x < 4; x++) 
+  {
+    CHECK_EQUAL(statuses[x], MP3_STATUS_PLAYING);
+    CHECK_EQUAL(device[x].getVolume(), 7);
+  }
+  
+  // One which doesn't answer doesn't hold up the others' answers
+  device[2].setDropRate(100);
+  CHECK_EQUAL(fleet.getStatus(statuses), 3);
+  CHECK_EQUAL(statuses[1], MP3_STATUS_PLAYING);
+  device[2].setDropRate(0);
+  
+  // Each keeps its own statistics
+  CHECK_EQUAL(fleet.getStats(0).responses, 3);
+  CHECK_EQUAL(fleet.getStats(2).responses, 2);
+  CHECK_EQUAL(fleet.getStats(2).timeouts, 1);
+  CHECK_BETWEEN(fleet.getStats(3).rttLast, 35, 60);
+  fleet.resetStats();
+  CHECK_EQUAL(fleet.getStats(0).responses, 0);
+  
+  // Started together, each seen playing as soon as it has opened the file
+  for(uint8_t x = 0; x < 4; x++)
+  {
+    device[x].setLatency(3);
+    device[x].setStartDelay(10 + x * 15);
+  }
+  
+  uint16_t skews[4];
+  CHECK_EQUAL(fleet.syncPlay(1, skews), 4);
+  CHECK_EQUAL(skews[0], 0);
+  for(uint8_t x = 1; x < 4; x++) CHECK_BETWEEN(skews[x], x * 15 - 10, x * 15 + 10);
+  
+  // One which can't play is reported as not starting
+  device[2].clearFiles();
+  CHECK_EQUAL(fleet.syncPlay(1, skews), 3);
+  CHECK_EQUAL(skews[2], 0xFFFF);
+  
+  return testResult("test_fleet");
+}
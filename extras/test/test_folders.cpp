@@ -0,0 +1,110 @@
+/**
+ * The folder map: folders are found on the device by name once and then 
+ * played by FAT index number, folders not in the map still go by path, and
+ * playing from the map plays the same file as playing by path.
+ */
+
+#include "test.h"
+
+/** Build a map of folders 01 to 04 on the given files, then play a file
+ *  from the map.
+ * 
+ * @return Index number played, 0 if it was played by path (not from the map).
+ */
+
+static uint16_t playMapped(const char **paths, uint8_t count, MP3FolderMapEntry *map, uint8_t folder, uint16_t file)
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  for(uint8_t x = 0; x < count; x++) device.addFile(MP3_SRC_SDCARD, paths[x], 100);
+  
+  mp3.setVolume(20);
+  mp3.buildFolderMap(map, 4);
+  CHECK_EQUAL(device.getVolume(), 20);
+  
+  mp3.playFileNumberInFolderNumber(folder, file);
+  return device.lastCommand() == 0x07 ? device.currentFileIndexNumber() : 0;
+}
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 30);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 30);
+  device.addFile(MP3_SRC_SDCARD, "/02/001.mp3", 30);
+  device.addFile(MP3_SRC_SDCARD, "/02/002.mp3", 30);
+  device.addFile(MP3_SRC_SDCARD, "/02/003.mp3", 30);
+  device.addFile(MP3_SRC_SDCARD, "/03/001.mp3", 30);
+  
+  // Nothing mapped yet
+  CHECK_EQUAL(mp3.countFilesInFolder(2), 0);
+  CHECK_EQUAL(mp3.firstIndexInFolder(2), 0);
+  
+  // Only room for two folders
+  MP3FolderMapEntry folders[2];
+  CHECK_EQUAL(mp3.buildFolderMap(folders, 2), 2);
+  CHECK_EQUAL(folders[0].first, 1);
+  CHECK_EQUAL(folders[0].count, 2);
+  CHECK_EQUAL(folders[1].first, 3);
+  CHECK_EQUAL(folders[1].count, 3);
+  CHECK_EQUAL(mp3.countFilesInFolder(2), 3);
+  CHECK_EQUAL(mp3.firstIndexInFolder(2), 3);
+  
+  // Mapped folders play by index
+  mp3.playFileNumberInFolderNumber(2, 3);
+  CHECK_EQUAL(device.lastCommand(), 0x07); // PLAY_IDX
+  CHECK_EQUAL(device.currentFileIndexNumber(), 5);
+  
+  mp3.playInFolderNumber(1);
+  CHECK_EQUAL(device.lastCommand(), 0x07); // PLAY_IDX
+  CHECK_EQUAL(device.currentFileIndexNumber(), 1);
+  
+  // A file past the end of the folder, or a folder not in the map, goes by path
+  mp3.playFileNumberInFolderNumber(2, 4);
+  CHECK_EQUAL(device.lastCommand(), 0x08); // PLAY_FILE_FOLDER
+  
+  mp3.playFileNumberInFolderNumber(3, 1);
+  CHECK_EQUAL(device.lastCommand(), 0x08); // PLAY_FILE_FOLDER
+  CHECK_EQUAL(device.currentFileIndexNumber(), 6);
+  
+  // Changing source forgets the map
+  mp3.setSource(MP3_SRC_SDCARD);
+  CHECK_EQUAL(mp3.countFilesInFolder(2), 0);
+  
+  MP3FolderMapEntry map[4];
+  
+  const char *plain[] = { "/01/001.mp3", "/01/002.mp3", "/02/001.mp3", "/03/001.mp3", "/03/002.mp3", "/03/003.mp3" };
+  CHECK_EQUAL(playMapped(plain, 6, map, 3, 2), 5);
+  CHECK_EQUAL(map[0].first, 1); CHECK_EQUAL(map[0].count, 2); CHECK_EQUAL(map[0].number, 1);
+  CHECK_EQUAL(map[1].first, 3); CHECK_EQUAL(map[1].count, 1);
+  CHECK_EQUAL(map[2].first, 4); CHECK_EQUAL(map[2].count, 3);
+  CHECK_EQUAL(map[3].first, 0);
+  
+  // A file in the root is not folder 01
+  const char *root[] = { "/root.mp3", "/01/001.mp3", "/01/002.mp3", "/02/001.mp3" };
+  CHECK_EQUAL(playMapped(root, 4, map, 1, 1), 2);
+  CHECK_EQUAL(playMapped(root, 4, map, 2, 1), 4);
+  
+  // Nor is folder 03 folder 02 when there isn't one
+  const char *missing[] = { "/01/001.mp3", "/03/001.mp3", "/03/002.mp3" };
+  CHECK_EQUAL(playMapped(missing, 3, map, 2, 1), 0);
+  CHECK_EQUAL(map[1].first, 0);
+  CHECK_EQUAL(playMapped(missing, 3, map, 3, 1), 2);
+  
+  // Files numbered from 000
+  const char *zero[] = { "/01/000.mp3", "/01/001.mp3", "/02/000.mp3" };
+  CHECK_EQUAL(playMapped(zero, 3, map, 1, 0), 1);
+  CHECK_EQUAL(playMapped(zero, 3, map, 1, 1), 2);
+  CHECK_EQUAL(map[0].number, 0);
+  
+  // Files not in order of name are played by path
+  const char *unsorted[] = { "/02/002.mp3", "/02/001.mp3", "/01/001.mp3" };
+  CHECK_EQUAL(playMapped(unsorted, 3, map, 2, 1), 0);
+  CHECK_EQUAL(map[1].number, MP3_FOLDER_UNNUMBERED);
+  CHECK_EQUAL(playMapped(unsorted, 3, map, 1, 1), 3);
+  
+  return testResult("test_folders");
+}
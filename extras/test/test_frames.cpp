@@ -0,0 +1,94 @@
+/**
+ * Frames sent to the device: each is written in one piece, and long ones 
+ * in as few pieces as they can be.  Fixed frames (play(), stop(), setVolume()...)
+ * which are built by the compiler come out the same as any other.
+ */
+
+#include "test.h"
+
+/** The checksum of the frame at sent[start] is good */
+
+static uint8_t frameGood(TestStream &device, uint16_t start)
+{
+  uint8_t length = device.sent[start + 2];
+  uint8_t sum    = 0;
+  for(uint16_t x = start; x < start + 3 + length; x++) sum += device.sent[x];
+  return sum == device.sent[start + 3 + length];
+}
+
+int main()
+{
+  TestStream    device;
+  JQ8400_Serial mp3(device);
+  
+  mp3.play();
+  CHECK_EQUAL(device.writes, 1);
+  CHECK_EQUAL(device.sentLength, 4);
+  CHECK(frameGood(device, 0));
+  
+  mp3.setVolume(20);
+  CHECK_EQUAL(device.writes, 2);
+  CHECK_EQUAL(device.sentLength, 9);
+  CHECK(frameGood(device, 4));
+  
+  // 12 files is 24 data bytes, a 28 byte frame
+  const char *names[12] = { "01", "02", "03", "04", "05", "06", "07", "08", "09", "10", "11", "12" };
+  mp3.playSequenceByFileName(names, 12);
+  CHECK_EQUAL(device.writes, 4);
+  CHECK_EQUAL(device.sentLength, 37);
+  CHECK_EQUAL(device.sent[11], 24);
+  CHECK(frameGood(device, 9));
+  
+  // Frames with no data, and with a single byte
+  {
+    TestStream    device;
+    JQ8400_Serial mp3(device);
+    
+    mp3.play();
+    mp3.stop();
+    mp3.next();
+    mp3.setVolume(20);
+    mp3.setEqualizer(MP3_EQ_ROCK);
+    
+    const uint8_t expected[] = 
+    { 
+      0xAA, 0x02, 0x00, 0xAC,
+      0xAA, 0x10, 0x00, 0xBA,
+      0xAA, 0x06, 0x00, 0xB0,
+      0xAA, 0x13, 0x01, 20, 0xD2,
+      0xAA, 0x1A, 0x01, MP3_EQ_ROCK, (uint8_t)(0xC5 + MP3_EQ_ROCK)
+    };
+    CHECK_EQUAL(device.sentLength, sizeof(expected));
+    CHECK(!memcmp(device.sent, expected, sizeof(expected)));
+    CHECK_EQUAL(device.writes, 5);
+  }
+  
+  // Configuration changes go together
+  {
+    TestStream    device;
+    JQ8400_Serial mp3(device);
+    
+    MP3Config config = { 25, MP3_EQ_ROCK, MP3_LOOP_ONE };
+    CHECK_EQUAL(mp3.applyConfig(config), 3);
+    CHECK_EQUAL(device.writes, 1);
+    CHECK_EQUAL(device.sentLength, 15);
+    CHECK(frameGood(device, 0) && frameGood(device, 5) && frameGood(device, 10));
+  }
+  
+#if MP3_ASYNC
+  // In async mode they wait in the queue like everything else
+  {
+    TestStream    device;
+    JQ8400_Serial mp3(device);
+    
+    mp3.setAsync(true);
+    mp3.play();
+    CHECK_EQUAL(device.sentLength, 0);
+    mp3.update();
+    CHECK_EQUAL(device.sentLength, 4);
+    CHECK(frameGood(device, 0));
+  }
+#endif
+  
+  return testResult("test_frames");
+}
@@ -0,0 +1,92 @@
+/**
+ * Frame handlers: frames which are not the response being waited for go 
+ * to the handlers registered with onFrame().
+ */
+
+#include "test.h"
+
+#if MP3_FRAME_HANDLERS
+static uint8_t anyCommand    = 0;
+static uint8_t anyLength     = 0;
+static uint8_t anyData       = 0;
+static uint8_t anyLast       = 0;
+static uint8_t statusFrames  = 0;
+
+static void onAny(JQ8400_Serial &mp3, uint8_t command, const uint8_t *data, uint8_t length)
+{
+  (void)mp3;
+  anyCommand = command;
+  anyLength  = length;
+  anyData    = length ? data[0] : 0;
+  anyLast    = length >= MP3_FRAME_DATA_LENGTH ? data[MP3_FRAME_DATA_LENGTH-1] : 0;
+}
+
+static void onStatus(JQ8400_Serial &mp3, uint8_t command, const uint8_t *data, uint8_t length)
+{
+  (void)mp3; (void)command; (void)data; (void)length;
+  statusFrames++;
+}
+#endif
+
+int main()
+{
+#if MP3_FRAME_HANDLERS
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 100);
+  
+  // A response which arrives after we gave up on it goes to the handler, 
+  //  not taken for the answer to the next query
+  CHECK(mp3.onFrame(MP3_FRAME_ANY, onAny));
+  mp3.playFileByIndexNumber(1);
+  device.setLatency(1100, 0);
+  CHECK_EQUAL(mp3.getStatus(), 0);
+  VirtualClock::advance(200);
+  device.setLatency(5, 0);
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(anyCommand, 0x01);
+  CHECK_EQUAL(anyLength, 1);
+  CHECK_EQUAL(anyData, MP3_STATUS_PLAYING);
+  
+  // Handlers for a command, and for any
+  anyCommand = 0;
+  CHECK(mp3.onFrame(0x01, onStatus));
+  device.setLatency(1100, 0);
+  mp3.getStatus();
+  VirtualClock::advance(200);
+  mp3.update();
+  CHECK_EQUAL(statusFrames, 1);
+  CHECK_EQUAL(anyCommand, 0x01);
+  
+  // Removed
+  CHECK(mp3.onFrame(0x01, 0));
+  mp3.getStatus();
+  VirtualClock::advance(200);
+  mp3.update();
+  CHECK_EQUAL(statusFrames, 1);
+  device.setLatency(5, 0);
+  
+  // Only so many
+  for(uint8_t x = 1; x < MP3_FRAME_HANDLERS; x++) CHECK(mp3.onFrame(0x10 + x, onStatus));
+  CHECK(!mp3.onFrame(0x20, onStatus));
+  
+  // A long frame is given whole as its length, but only the first few bytes
+  {
+    TestStream    script;
+    JQ8400_Serial other(script);
+    other.onFrame(MP3_FRAME_ANY, onAny);
+    const uint8_t name[] = { 0xAA, 0x1E, 0x08, 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 0xF4 }; // CURRENT_FILE_NAME
+    script.reply(name, sizeof(name));
+    other.play();
+    other.update();
+    CHECK_EQUAL(anyCommand, 0x1E);
+    CHECK_EQUAL(anyLength, 8);
+    CHECK_EQUAL(anyData, 'A');
+    CHECK_EQUAL(anyLast, 'D');
+  }
+#endif
+  
+  return testResult("test_handlers");
+}
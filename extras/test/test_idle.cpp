@@ -0,0 +1,58 @@
+/**
+ * The idle function is called while waiting for a response, with the time
+ * left before the timeout.
+ */
+
+#include "test.h"
+
+static uint16_t idleCalls      = 0;
+static uint16_t firstRemaining = 0;
+static uint16_t lastRemaining  = 0;
+
+static void work(JQ8400_Serial &mp3, uint16_t remaining)
+{
+  if(!idleCalls) firstRemaining = remaining;
+  lastRemaining = remaining;
+  idleCalls++;
+  JQ8400_Serial::idleDelay(mp3, remaining);
+}
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  device.setLatency(5);
+  
+  // Called while the response is on its way, counting down from the timeout
+  mp3.setIdle(work);
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_STOPPED);
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_OK);
+  CHECK_BETWEEN(idleCalls, 3, 20);
+  CHECK_BETWEEN(firstRemaining, 990, 1000);
+  
+  // And until the timeout if it never comes
+  device.setDropRate(100);
+  mp3.setTimeouts(50, 20);
+  idleCalls = 0;
+  unsigned long start = VirtualClock::millis();
+  mp3.getStatus();
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_TIMEOUT);
+  CHECK_BETWEEN(VirtualClock::millis() - start, 50, 55);
+  CHECK_BETWEEN(idleCalls, 40, 55);
+  CHECK_BETWEEN(lastRemaining, 1, 5);
+  
+  // Commands with no response don't wait
+  idleCalls = 0;
+  mp3.play();
+  CHECK_EQUAL(idleCalls, 0);
+  
+  // idleDelay() uses the time source
+  mp3.setIdle(JQ8400_Serial::idleDelay);
+  start = VirtualClock::millis();
+  mp3.getStatus();
+  CHECK_BETWEEN(VirtualClock::millis() - start, 50, 55);
+  
+  return testResult("test_idle");
+}
@@ -0,0 +1,98 @@
+/**
+ * Playlists: entries the device can't take are skipped, and lists longer 
+ * than a frame holds are sent in parts as the device finishes each.
+ */
+
+#include "test.h"
+
+static uint32_t updateTime = 0;  ///< Time spent in update(), it never waits
+
+/** Run update() for a while, counting the files the device starts */
+
+static uint16_t playFor(JQ8400_Serial &mp3, JQ8400_Emulator &device, uint32_t ms)
+{
+  uint16_t started = 0;
+  uint16_t last    = device.currentFileIndexNumber();
+  
+  for(uint32_t t = 0; t < ms; t += 50)
+  {
+    uint32_t before = VirtualClock::millis();
+    mp3.update();
+    updateTime += VirtualClock::millis() - before;
+    VirtualClock::advance(50);
+    
+    uint16_t index = device.currentFileIndexNumber();
+    if(index != last && device.getStatus() == MP3_STATUS_PLAYING) started++;
+    last = index;
+  }
+  return started;
+}
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  
+  char name[16];
+  for(uint8_t x = 1; x <= 12; x++)
+  {
+    sprintf(name, "/ZH/%02u.mp3", x);
+    device.addFile(MP3_SRC_SDCARD, name, 2);
+  }
+  
+  // Numbers over 99 are skipped, 10 and up are two digits
+  uint8_t numbers[] = { 12, 100, 5, 10 };
+  mp3.playSequenceByFileNumber(numbers, 4);
+  CHECK_EQUAL(device.currentFileIndexNumber(), 12);
+  VirtualClock::advance(2100);
+  CHECK_EQUAL(device.currentFileIndexNumber(), 5);
+  VirtualClock::advance(2100);
+  CHECK_EQUAL(device.currentFileIndexNumber(), 10);
+  
+  // Names which are not 2 characters are skipped
+  const char *names[] = { "03", "x", "04x", "07" };
+  mp3.playSequenceByFileName(names, 4);
+  CHECK_EQUAL(device.currentFileIndexNumber(), 3);
+  VirtualClock::advance(2100);
+  CHECK_EQUAL(device.currentFileIndexNumber(), 7);
+  
+  // A playlist checks what is added to it
+  JQ8400_FixedPlaylist<10> small;
+  CHECK(small.addNumber(1));
+  CHECK(!small.addNumber(100));
+  CHECK(!small.addName("abc"));
+  CHECK(small.addName("02"));
+  CHECK_EQUAL(small.length(), 2);
+  for(uint8_t x = 3; x <= 10; x++) small.addNumber(x);
+  CHECK(!small.addNumber(11));
+  
+  // File 00 is as good as any other
+  JQ8400_FixedPlaylist<1> zero;
+  CHECK(zero.addNumber(0));
+  CHECK_EQUAL(zero.length(), 1);
+  
+  // Short enough to go in one frame
+  mp3.playSequence(small);
+  CHECK_EQUAL(device.currentFileIndexNumber(), 1);
+  CHECK_EQUAL(playFor(mp3, device, 25000), 9);
+  CHECK_EQUAL(device.getStatus(), MP3_STATUS_STOPPED);
+  
+  // Longer than a frame holds, the rest follows when the first part is done
+  JQ8400_FixedPlaylist<MP3_PLAYLIST_FRAME_ENTRIES + 3> large;
+  for(uint16_t x = 0; x < MP3_PLAYLIST_FRAME_ENTRIES + 3; x++) large.addNumber(x % 12 + 1);
+  
+  mp3.playSequence(large);
+  CHECK_EQUAL(playFor(mp3, device, (MP3_PLAYLIST_FRAME_ENTRIES + 3) * 2000UL + 5000), MP3_PLAYLIST_FRAME_ENTRIES + 3 - 1);
+  CHECK_EQUAL(device.getStatus(), MP3_STATUS_STOPPED);
+  CHECK_EQUAL(updateTime, 0);
+  
+  // Stopping (or playing something else) abandons the rest
+  mp3.playSequence(large);
+  VirtualClock::advance(1000);
+  mp3.stop();
+  CHECK_EQUAL(playFor(mp3, device, 5000), 0);
+  CHECK_EQUAL(device.getStatus(), MP3_STATUS_STOPPED);
+  
+  return testResult("test_playlist");
+}
@@ -0,0 +1,113 @@
+/**
+ * Position subscription: the device's own reports keep the position up to
+ * date without asking for it.
+ */
+
+#include "test.h"
+
+static uint8_t  reports      = 0;
+static uint16_t lastReported = 0;
+
+static void onPosition(JQ8400_Serial &mp3, uint16_t seconds)
+{
+  (void)mp3;
+  reports++;
+  lastReported = seconds;
+}
+
+/** A device which never answers, but reports its position every 500ms, 10 times */
+
+class Reporter : public Stream
+{
+  public:
+    uint32_t nextAt      = 500;
+    uint8_t  reportsLeft = 10;
+    
+    size_t write(uint8_t c)                            { (void)c; return 1; }
+    size_t write(const uint8_t *buffer, size_t length) { (void)buffer; return length; }
+    
+    int available() { due(); return length - index; }
+    int read()      { due(); return index < length ? frame[index++] : -1; }
+    int peek()      { due(); return index < length ? frame[index]   : -1; }
+    
+  protected:
+    uint8_t frame[7];
+    uint8_t length = 0;
+    uint8_t index  = 0;
+    
+    void due()
+    {
+      if(index < length || !reportsLeft || VirtualClock::millis() < nextAt) return;
+      
+      const uint8_t report[7] = { 0xAA, 0x25, 0x03, 0x00, 0x00, 0x01, 0xD3 };
+      memcpy(frame, report, sizeof(frame));
+      length   = sizeof(frame);
+      index    = 0;
+      nextAt  += 500;
+      reportsLeft--;
+    }
+};
+
+static void updateFor(JQ8400_Serial &mp3, unsigned long ms)
+{
+  for(unsigned long x = 0; x < ms; x += 100)
+  {
+    mp3.update();
+    VirtualClock::advance(100);
+  }
+}
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 100);
+  
+  mp3.playFileByIndexNumber(1);
+  VirtualClock::advance(3000);
+  mp3.subscribePosition(onPosition);
+  CHECK_EQUAL(reports, 1);
+  CHECK_EQUAL(lastReported, 3);
+  
+  // A report every second, read by update()
+  updateFor(mp3, 5000);
+  CHECK_BETWEEN(reports, 5, 6);
+  CHECK_BETWEEN(lastReported, 7, 8);
+  
+  // Asking for the position doesn't ask the device
+  uint32_t frames = device.framesReceived();
+  CHECK_BETWEEN(mp3.currentFilePositionInSeconds(), 7, 8);
+  CHECK_EQUAL(device.framesReceived(), frames);
+  
+  // Queries are still answered between the reports
+  for(uint8_t x = 0; x < 20; x++)
+  {
+    CHECK_EQUAL(mp3.countFiles(), 2);
+    VirtualClock::advance(250);
+  }
+  CHECK_BETWEEN(mp3.currentFilePositionInSeconds(), 12, 13);
+  
+  // Until unsubscribed
+  mp3.unsubscribePosition();
+  uint8_t before = reports;
+  updateFor(mp3, 3000);
+  CHECK_EQUAL(reports, before);
+  
+  // Reports arriving while we wait for a response don't lengthen the wait
+  {
+    Reporter      reporter;
+    JQ8400_Serial other(reporter);
+    other.setTimeSource(VirtualClock::millis, VirtualClock::delay);
+    other.setTimeouts(1000, 20);
+    reporter.nextAt = VirtualClock::millis() + 500;
+    
+    unsigned long start = VirtualClock::millis();
+    other.countFiles();
+    CHECK_EQUAL(other.lastResult(), MP3_RESULT_TIMEOUT);
+    CHECK_BETWEEN(VirtualClock::millis() - start, 1000, 1050);
+  }
+  
+  return testResult("test_position");
+}
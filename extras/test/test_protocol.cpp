@@ -0,0 +1,84 @@
+/**
+ * Sending commands and reading responses over a poor connection.
+ */
+
+#include "test.h"
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 100);
+  device.setLatency(5, 3);
+  
+  CHECK_EQUAL(mp3.countFiles(), 2);
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_OK);
+  
+  // Every response corrupted, the checksum catches it
+  device.setCorruptRate(100);
+  mp3.countFiles();
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_CHECKSUM);
+  
+  // Some corrupted, retries get a good answer and never a wrong one
+  device.setCorruptRate(30);
+  device.setSeed(3);
+  mp3.setRetries(3);
+  uint8_t good = 0;
+  for(uint8_t x = 0; x < 50; x++)
+  {
+    uint16_t count = mp3.countFiles();
+    if(mp3.lastResult() == MP3_RESULT_OK)
+    {
+      good++;
+      CHECK_EQUAL(count, 2);
+    }
+  }
+  CHECK_BETWEEN(good, 48, 50);
+  
+  // The status too, asked until the answers agree
+  mp3.play();
+  good = 0;
+  for(uint8_t x = 0; x < 50; x++)
+  {
+    uint8_t status = mp3.getStatus();
+    if(mp3.lastResult() == MP3_RESULT_OK)
+    {
+      good++;
+      CHECK_EQUAL(status, MP3_STATUS_PLAYING);
+    }
+  }
+  CHECK_BETWEEN(good, 45, 50);
+  
+  // On a clean line the status is asked just once
+  device.setCorruptRate(0);
+  uint32_t frames = device.framesReceived();
+  for(uint8_t x = 0; x < 10; x++) mp3.getStatus();
+  CHECK_EQUAL(device.framesReceived() - frames, 10);
+  
+  // A lost response costs the timeout, and says so
+  device.setDropRate(100);
+  mp3.setRetries(0);
+  mp3.setTimeouts(100, 20);
+  unsigned long start = VirtualClock::millis();
+  mp3.getStatus();
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_TIMEOUT);
+  CHECK_BETWEEN(VirtualClock::millis() - start, 100, 110);
+  device.setDropRate(0);
+  
+  // A response with a good checksum but the wrong length is no answer
+  {
+    TestStream    script;
+    JQ8400_Serial other(script);
+    const uint8_t one[] = { 0x05 };
+    script.replyFrame(0x0C, one, 1);
+    CHECK_EQUAL(other.countFiles(), 0);
+    CHECK_EQUAL(other.lastResult(), MP3_RESULT_LENGTH);
+#if MP3_STATS
+    CHECK_EQUAL(other.getCommandStats(0x0C).lengthMismatches, 1);
+#endif
+  }
+  
+  return testResult("test_protocol");
+}
@@ -0,0 +1,100 @@
+/**
+ * The command queue: nothing is sent until update(), requests complete in 
+ * the background, and a blocking query waits for the queue first.
+ */
+
+#include "test.h"
+
+#if MP3_ASYNC
+static uint16_t callbackValue = 0;
+
+static void countReceived(JQ8400_Serial &player, MP3Result &result)
+{
+  (void)player;
+  callbackValue = result.state == MP3_RESULT_OK ? result.value : 0xFFFF;
+}
+
+static void updateUntilDone(JQ8400_Serial &mp3)
+{
+  for(uint16_t x = 0; x < 2000 && mp3.update(); x++);
+}
+#endif
+
+int main()
+{
+#if MP3_ASYNC
+  TestStream    device;
+  JQ8400_Serial mp3(device);
+  
+  // Commands wait for update(), one frame each time
+  mp3.setAsync(1);
+  mp3.play();
+  mp3.setVolume(10);
+  CHECK_EQUAL(device.sentLength, 0);
+  CHECK_EQUAL(mp3.update(), 1);
+  CHECK_EQUAL(device.sentLength, 4);
+  CHECK_EQUAL(device.sent[1], 0x02);
+  CHECK_EQUAL(mp3.update(), 0);
+  CHECK_EQUAL(device.sentLength, 9);
+  CHECK_EQUAL(device.sent[5], 0x13);
+  
+  // A request completes into the result
+  const uint8_t playing[] = { 0x01 };
+  MP3Result status;
+  device.replyFrame(0x01, playing, sizeof(playing));
+  CHECK(mp3.requestStatus(&status));
+  CHECK_EQUAL(status.state, MP3_RESULT_PENDING);
+  updateUntilDone(mp3);
+  CHECK_EQUAL(status.state, MP3_RESULT_OK);
+  CHECK_EQUAL(status.value, MP3_STATUS_PLAYING);
+  
+  // Or calls back
+  const uint8_t files[] = { 0x01, 0x02 };
+  device.replyFrame(0x0C, files, sizeof(files));
+  CHECK(mp3.requestCountFiles(0, countReceived));
+  updateUntilDone(mp3);
+  CHECK_EQUAL(callbackValue, 0x0102);
+  
+  // Without an answer it times out
+  CHECK(mp3.requestStatus(&status));
+  updateUntilDone(mp3);
+  CHECK_EQUAL(status.state, MP3_RESULT_TIMEOUT);
+  
+  // A blocking query sends what is queued first
+  const uint8_t index[] = { 0x00, 0x07 };
+  uint16_t sent = device.sentLength;
+  mp3.setVolume(12);
+  device.replyFrame(0x0D, index, sizeof(index));
+  CHECK_EQUAL(mp3.currentFileIndexNumber(), 7);
+  CHECK_EQUAL(device.sent[sent + 1], 0x13);
+  CHECK_EQUAL(device.sent[sent + 6], 0x0D);
+  
+  // The queue holds MP3_QUEUE_LENGTH
+  for(uint8_t x = 0; x < MP3_QUEUE_LENGTH; x++) CHECK(mp3.requestStatus(0));
+  CHECK(!mp3.requestStatus(0));
+  
+  // A blocking query behind a request which is waiting for its response 
+  //  waits for it (on the time source, not spinning), and a lost response 
+  //  ends in a timeout, not a hang
+  JQ8400_Emulator emulator;
+  JQ8400_Serial   player(emulator);
+  testConnect(player, emulator);
+  emulator.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  emulator.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 100);
+  
+  MP3Result reply;
+  player.setAsync(1);
+  player.requestStatus(&reply);
+  player.update();
+  CHECK_EQUAL(player.countFiles(), 2);
+  CHECK_EQUAL(reply.state, MP3_RESULT_OK);
+  
+  emulator.setDropRate(100);
+  player.requestStatus(&reply);
+  player.update();
+  player.countFiles();
+  CHECK_EQUAL(reply.state, MP3_RESULT_TIMEOUT);
+#endif
+  
+  return testResult("test_queue");
+}
@@ -0,0 +1,87 @@
+/**
+ * reset() probes for the device coming up rather than waiting blindly (or 
+ * flooding it), and configuration which hasn't changed isn't written again.
+ */
+
+#include "test.h"
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 3);
+  device.setLatency(5, 3);
+  
+  // Already running, answered at the first probe
+  uint16_t ready;
+  unsigned long start = VirtualClock::millis();
+  CHECK_EQUAL(mp3.reset(&ready), MP3_RESULT_OK);
+  CHECK_BETWEEN(ready, 1, 30);
+  CHECK_BETWEEN(VirtualClock::millis() - start, 1, 30);
+  CHECK_EQUAL(device.getVolume(), 20);
+  
+  // Takes 300ms to boot, found within one probe of that
+  device.powerOn(300);
+  mp3.setVolume(5);
+  start = VirtualClock::millis();
+  CHECK_EQUAL(mp3.reset(&ready), MP3_RESULT_OK);
+  CHECK_BETWEEN(ready, 300, 300 + MP3_RESET_PROBE_MAX);
+  CHECK_EQUAL(device.getVolume(), 20);
+  printf("reset: ready after %ums\n", ready);
+  
+  // Never comes up, gives up at the reset timeout
+  device.powerOn(5000);
+  mp3.setResetTimeout(400);
+  start = VirtualClock::millis();
+  CHECK_EQUAL(mp3.reset(&ready), MP3_RESULT_TIMEOUT);
+  CHECK_BETWEEN(VirtualClock::millis() - start, 400, 410);
+  VirtualClock::advance(5000);
+  
+  // Writing what was written already sends nothing
+  CHECK_EQUAL(mp3.reset(), MP3_RESULT_OK);
+  mp3.setWriteOnChange(1);
+  uint32_t frames = device.framesReceived();
+  for(uint8_t x = 0; x < 10; x++)
+  {
+    mp3.setVolume(20);
+    mp3.setEqualizer(0);
+    mp3.setLoopMode(MP3_LOOP_NONE);
+  }
+  CHECK_EQUAL(device.framesReceived() - frames, 0);
+  
+  mp3.setVolume(12);
+  CHECK_EQUAL(device.framesReceived() - frames, 1);
+  CHECK_EQUAL(device.getVolume(), 12);
+  
+  // Only what changed, all at once
+  MP3Config config = { 25, 3, MP3_LOOP_ONE };
+  frames = device.framesReceived();
+  CHECK_EQUAL(mp3.applyConfig(config), 3);
+  CHECK_EQUAL(device.framesReceived() - frames, 3);
+  CHECK_EQUAL(device.getVolume(), 25);
+  CHECK_EQUAL(device.getEqualizer(), 3);
+  CHECK_EQUAL(device.getLoopMode(), MP3_LOOP_ONE);
+  CHECK_EQUAL(mp3.applyConfig(config), 0);
+  
+  config.volume = 5;
+  CHECK_EQUAL(mp3.applyConfig(config), 1);
+  CHECK_EQUAL(device.getVolume(), 5);
+  
+  mp3.markDirty();
+  CHECK_EQUAL(mp3.applyConfig(config), 3);
+  
+  // No media, the device answers at once but each probe still waits its 
+  //  turn, and the defaults are set all the same
+  device.clearFiles();
+  mp3.setVolume(5);
+  frames = device.framesReceived();
+  start  = VirtualClock::millis();
+  CHECK_EQUAL(mp3.reset(&ready), MP3_RESULT_NO_SOURCES);
+  CHECK_BETWEEN(VirtualClock::millis() - start, 400, 410);
+  CHECK_BETWEEN(device.framesReceived() - frames, 2 + 6, 2 + 8 + 5);
+  CHECK_EQUAL(device.getVolume(), 20);
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_NO_SOURCES);
+  
+  return testResult("test_reset");
+}
@@ -0,0 +1,64 @@
+/**
+ * Reading responses: a read ends with the frame's checksum byte, leaves 
+ * whatever follows in the stream, and skips frames for other commands.
+ */
+
+#include "test.h"
+
+int main()
+{
+  TestStream    device;
+  JQ8400_Serial mp3(device);
+  
+  // The answer is done with as soon as its checksum arrives
+  const uint8_t files[] = { 0x00, 0x05 };
+  const uint8_t extra   = 0x55;
+  device.replyFrame(0x0C, files, sizeof(files));
+  device.reply(&extra, 1);
+  
+  unsigned long start = millis();
+  CHECK_EQUAL(mp3.countFiles(), 5);
+  CHECK_BETWEEN(millis() - start, 0, 100);
+  CHECK_EQUAL(device.available(), 1);
+  CHECK_EQUAL(device.read(), 0x55);
+  
+  // Line garbage before the frame is skipped
+  const uint8_t garbage[] = { 0x00, 0x13 };
+  const uint8_t index[]   = { 0x00, 0x03 };
+  device.reply(garbage, sizeof(garbage));
+  device.replyFrame(0x0D, index, sizeof(index));
+  CHECK_EQUAL(mp3.currentFileIndexNumber(), 3);
+  
+  // A bad checksum gives nothing
+  const uint8_t corrupt[] = { 0xAA, 0x0C, 0x02, 0x00, 0x05, 0x00 };
+  device.reply(corrupt, sizeof(corrupt));
+  CHECK_EQUAL(mp3.countFiles(), 0);
+  
+  // A late answer to something else is not taken for ours
+  const uint8_t status[] = { 0xAA, 0x01, 0x01, 0x01, 0xAC };
+  device.reply(status, sizeof(status));
+  device.replyFrame(0x0C, files, sizeof(files));
+  CHECK_EQUAL(mp3.countFiles(), 5);
+  
+  // As does no answer at all, after the full wait
+  start = millis();
+  CHECK_EQUAL(mp3.countFiles(), 0);
+  CHECK_BETWEEN(millis() - start, 1000, 1100);
+  
+  // Data of a frame for something else is not left behind a shorter answer of ours
+  const uint8_t other[] = { 0xAA, 0x20, 0x08, 'X', 'X', 'X', 'X', 'X', 'X', 'X', 'X', 0x92 };
+  const uint8_t name[]  = { 'A', 'B' };
+  char          found[12] = { };
+  device.reply(other, sizeof(other));
+  device.replyFrame(0x1E, name, sizeof(name));
+  mp3.currentFileName(found, sizeof(found));
+  CHECK(!strcmp(found, "AB"));
+  
+  // Sending a command doesn't wait to see if garbage arrives first
+  mp3.setTimeSource(VirtualClock::millis, VirtualClock::delay);
+  start = VirtualClock::millis();
+  mp3.play();
+  CHECK_EQUAL(VirtualClock::millis() - start, 0);
+  
+  return testResult("test_response");
+}
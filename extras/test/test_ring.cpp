@@ -0,0 +1,105 @@
+/**
+ * The receive ring: bytes are handed over by an "interrupt" with 
+ * onReceive() and read from the ring, not the stream.
+ */
+
+#include "test.h"
+
+/** Writes go to the emulator, but nothing can be read, as with a UART 
+ *  whose bytes are all taken by its interrupt.
+ */
+
+class WriteOnly : public Stream
+{
+  public:
+    WriteOnly(JQ8400_Emulator &device) : device(device) { }
+    
+    size_t write(uint8_t c)                            { return device.write(c); }
+    size_t write(const uint8_t *buffer, size_t length) { return device.write(buffer, length); }
+    
+    int available() { return 0;  }
+    int read()      { return -1; }
+    int peek()      { return -1; }
+    
+  protected:
+    JQ8400_Emulator &device;
+};
+
+static JQ8400_Emulator *uart   = 0;
+static JQ8400_Serial   *player = 0;
+
+/** The "interrupt", a few bytes at a time */
+
+static void receiveInterrupt()
+{
+  uint8_t bytes[7];
+  size_t  length = 0;
+  while(uart->available() && length < sizeof(bytes)) bytes[length++] = uart->read();
+  if(length) player->onReceive(bytes, length);
+}
+
+static void idle(JQ8400_Serial &mp3, uint16_t remaining)
+{
+  receiveInterrupt();
+  JQ8400_Serial::idleDelay(mp3, remaining);
+}
+
+int main()
+{
+  JQ8400_Emulator device;
+  WriteOnly       serial(device);
+  JQ8400_Serial   mp3(serial);
+  testConnect(mp3, device);
+  uart   = &device;
+  player = &mp3;
+  
+  char path[20];
+  for(uint8_t x = 0; x < 5; x++)
+  {
+    sprintf(path, "/01/%03u.mp3", x);
+    device.addFile(MP3_SRC_SDCARD, path, 100);
+  }
+  device.setLatency(5, 2);
+  
+  uint8_t ring[16];
+  mp3.setReceiveBuffer(ring, sizeof(ring));
+  mp3.setIdle(idle);
+  
+  // Responses come through the ring, including one longer than it
+  CHECK_EQUAL(mp3.countFiles(), 5);
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_OK);
+  mp3.playFileByIndexNumber(3);
+  CHECK_EQUAL(mp3.currentFileIndexNumber(), 3);
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_PLAYING);
+  
+  char name[20];
+  mp3.currentFileName(name, sizeof(name));
+  CHECK(!strcmp(name, "002MP3"));
+  CHECK_EQUAL(mp3.receiveOverflows(), 0);
+  
+  // What doesn't fit is counted, not taken
+  uint8_t junk[40] = { };
+  CHECK_EQUAL(mp3.onReceive(junk, sizeof(junk)), sizeof(ring) - 1);
+  CHECK_EQUAL(mp3.receiveOverflows(), sizeof(junk) - (sizeof(ring) - 1));
+  
+  // Setting the buffer again empties it
+  mp3.setReceiveBuffer(ring, sizeof(ring));
+  CHECK_EQUAL(mp3.getStatus(), MP3_STATUS_PLAYING);
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_OK);
+  
+#if MP3_ASYNC
+  // update() reads the ring too
+  MP3Result status;
+  mp3.requestStatus(&status);
+  for(uint16_t x = 0; x < 2000 && status.state == MP3_RESULT_PENDING; x++)
+  {
+    receiveInterrupt();
+    mp3.update();
+    VirtualClock::delay(1);
+  }
+  CHECK_EQUAL(status.state, MP3_RESULT_OK);
+  CHECK_EQUAL(status.value, MP3_STATUS_PLAYING);
+#endif
+  
+  return testResult("test_ring");
+}
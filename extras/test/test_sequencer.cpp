@@ -0,0 +1,67 @@
+/**
+ * The sequencer: files play in the order given with little gap between, 
+ * and the device is left alone while each plays.
+ */
+
+#include "test.h"
+#include "../../src/JQ8400_Sequencer.h"
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 3);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 2);
+  device.addFile(MP3_SRC_SDCARD, "/01/003.mp3", 4);
+  
+  uint16_t         files[] = { 2, 1, 3, 1 };
+  JQ8400_Sequencer sequence(mp3, files, 4);
+  
+  uint16_t played[8];
+  uint8_t  playedCount = 0;
+  uint16_t last        = 0;
+  uint32_t longestGap  = 0;
+  uint32_t gap         = 0;
+  uint32_t start       = VirtualClock::millis();
+  
+  sequence.start();
+  CHECK(sequence.running());
+  CHECK_EQUAL(device.getLoopMode(), MP3_LOOP_NONE);
+  
+  while(sequence.update() && VirtualClock::millis() - start < 30000)
+  {
+    VirtualClock::advance(1);
+    
+    if(device.getStatus() != MP3_STATUS_PLAYING)
+    {
+      if(++gap > longestGap) longestGap = gap;
+      continue;
+    }
+    gap = 0;
+    
+    uint16_t index = device.currentFileIndexNumber();
+    if(index != last && playedCount < 8) played[playedCount++] = index;
+    last = index;
+  }
+  
+  // In order, 12 seconds of files with gaps of a few ms
+  CHECK(!sequence.running());
+  CHECK_EQUAL(playedCount, 4);
+  for(uint8_t x = 0; x < 4 && x < playedCount; x++) CHECK_EQUAL(played[x], files[x]);
+  CHECK_BETWEEN(VirtualClock::millis() - start, 12000, 13000);
+  CHECK_BETWEEN(longestGap, 0, 100);
+  
+  // Only asked near the end of each file
+  CHECK_BETWEEN(sequence.polls(), 4, 100);
+  
+  // Stopping stops the device
+  sequence.setRepeat(1);
+  sequence.start(3);
+  CHECK_EQUAL(device.currentFileIndexNumber(), 1);
+  sequence.stop();
+  CHECK(!sequence.update());
+  CHECK_EQUAL(device.getStatus(), MP3_STATUS_STOPPED);
+  
+  return testResult("test_sequencer");
+}
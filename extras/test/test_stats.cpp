@@ -0,0 +1,57 @@
+/**
+ * Statistics: what was sent and how each query was answered.
+ */
+
+#include "test.h"
+
+int main()
+{
+#if MP3_STATS
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  device.setLatency(20, 0);
+  
+  mp3.countFiles();
+  mp3.countFiles();
+  mp3.play();
+  
+  const MP3Stats &stats = mp3.getStats();
+  CHECK_EQUAL(stats.bytesSent, 12);
+  CHECK_EQUAL(stats.bytesReceived, 12);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).sent, 2);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).responses, 2);
+  CHECK_BETWEEN(mp3.getCommandStats(0x0C).rttMin, 20, 30);
+  CHECK_BETWEEN(mp3.getCommandStats(0x0C).rttMax, 20, 30);
+  CHECK_BETWEEN(mp3.getCommandStats(0x0C).rttTotal, 40, 60);
+  CHECK_EQUAL(mp3.getCommandStats(0x02).sent, 1);
+  CHECK_EQUAL(mp3.getCommandStats(0x02).responses, 0);
+  
+  // Commands which aren't queries are counted together
+  mp3.stop();
+  CHECK_EQUAL(mp3.getCommandStats(0x10).sent, 2);
+  CHECK_EQUAL(&mp3.getCommandStats(0x10), &mp3.getCommandStats(0x02));
+  CHECK(&mp3.getCommandStats(0x01) != &mp3.getCommandStats(0x0C));
+  
+  // Failures are counted by kind
+  device.setCorruptRate(100);
+  mp3.countFiles();
+  device.setCorruptRate(0);
+  device.setDropRate(100);
+  mp3.countFiles();
+  device.setDropRate(0);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).sent, 4);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).responses, 2);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).checksumFailures, 1);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).timeouts, 1);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).interByteTimeouts, 0);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).lastTimeout, 1000);
+  
+  mp3.resetStats();
+  CHECK_EQUAL(stats.bytesSent, 0);
+  CHECK_EQUAL(mp3.getCommandStats(0x0C).sent, 0);
+#endif
+  
+  return testResult("test_stats");
+}
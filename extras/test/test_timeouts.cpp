@@ -0,0 +1,51 @@
+/**
+ * Adaptive timeouts learn how quickly the device answers, so a lost 
+ * response costs little once learned.
+ */
+
+#include "test.h"
+
+int main()
+{
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  device.setLatency(5, 3);
+  
+  CHECK_EQUAL(mp3.getTimeout(0x01), 1000);
+  
+#if MP3_ADAPTIVE_TIMEOUTS
+  mp3.setAdaptiveTimeouts(1);
+  for(uint8_t x = 0; x < 20; x++) mp3.getStatus();
+  CHECK_BETWEEN(mp3.getTimeout(0x01), MP3_TIMEOUT_MIN, 50);
+  
+  // Only the group asked about has learned anything
+  CHECK_EQUAL(mp3.getTimeout(0x1E), 1000);
+  
+  device.setDropRate(100);
+  unsigned long start = VirtualClock::millis();
+  mp3.getStatus();
+  unsigned long lost = VirtualClock::millis() - start;
+  CHECK_EQUAL(mp3.lastResult(), MP3_RESULT_TIMEOUT);
+  CHECK_BETWEEN(lost, MP3_TIMEOUT_MIN, 50);
+  printf("timeouts: a lost response costs %lums once learned\n", lost);
+  
+  // Backed off, then learned again
+  CHECK(mp3.getTimeout(0x01) >= lost);
+  device.setDropRate(0);
+  for(uint8_t x = 0; x < 20; x++) mp3.getStatus();
+  CHECK_BETWEEN(mp3.getTimeout(0x01), MP3_TIMEOUT_MIN, 50);
+  
+  mp3.setAdaptiveTimeouts(0);
+#endif
+  
+  // Fixed timeouts are what they are set to
+  mp3.setTimeouts(100, 20);
+  device.setDropRate(100);
+  unsigned long fixed = VirtualClock::millis();
+  mp3.getStatus();
+  CHECK_BETWEEN(VirtualClock::millis() - fixed, 100, 105);
+  
+  return testResult("test_timeouts");
+}
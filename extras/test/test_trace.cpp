@@ -0,0 +1,95 @@
+/**
+ * The frame trace: what is recorded, dumpTrace() and decode_trace.py
+ */
+
+#include "test.h"
+
+#if MP3_TRACE
+/** Collects what is printed to it */
+
+class TestPrint : public Print
+{
+  public:
+    char   text[1024];
+    size_t length = 0;
+    
+    size_t write(uint8_t c)
+    {
+      if(length + 1 >= sizeof(text)) return 0;
+      text[length++] = c;
+      text[length]   = 0;
+      return 1;
+    }
+};
+#endif
+
+int main()
+{
+#if MP3_TRACE
+  JQ8400_Emulator device;
+  JQ8400_Serial   mp3(device);
+  testConnect(mp3, device);
+  device.addFile(MP3_SRC_SDCARD, "/01/001.mp3", 100);
+  device.addFile(MP3_SRC_SDCARD, "/01/002.mp3", 100);
+  
+  mp3.clearTrace();
+  mp3.setVolume(15);
+  mp3.countFiles();
+  device.setDropRate(100);
+  mp3.getStatus();
+  device.setDropRate(0);
+  
+  // Sent, sent and answered, sent and timed out
+  MP3TraceRecord records[MP3_TRACE_LENGTH];
+  CHECK_EQUAL(mp3.getTrace(records, MP3_TRACE_LENGTH), 5);
+  CHECK_EQUAL(records[0].flags,   MP3_TRACE_TX);
+  CHECK_EQUAL(records[0].command, 0x13);
+  CHECK_EQUAL(records[0].length,  1);
+  CHECK_EQUAL(records[0].data[0], 15);
+  CHECK_EQUAL(records[1].command, 0x0C);
+  CHECK_EQUAL(records[2].flags,   MP3_TRACE_RX);
+  CHECK_EQUAL(records[2].command, 0x0C);
+  CHECK_EQUAL(records[2].length,  2);
+  CHECK_EQUAL(records[2].data[1], 2);
+  CHECK_EQUAL(records[3].command, 0x01);
+  CHECK_EQUAL(records[4].flags,   MP3_TRACE_RX | MP3_TRACE_TIMEOUT);
+  CHECK_EQUAL(records[4].command, 0x01);
+  
+  // Only the latest are kept
+  for(uint8_t x = 0; x < MP3_TRACE_LENGTH; x++) mp3.setVolume(x);
+  CHECK_EQUAL(mp3.getTrace(records, MP3_TRACE_LENGTH), MP3_TRACE_LENGTH);
+  CHECK_EQUAL(records[MP3_TRACE_LENGTH-1].data[0], MP3_TRACE_LENGTH-1);
+  
+  // A dump has a line per frame, which decode_trace.py can read
+  mp3.clearTrace();
+  mp3.countFiles();
+  TestPrint dump;
+  mp3.dumpTrace(dump);
+  CHECK(strstr(dump.text, " 00 0C 00 000000\n") != 0);
+  CHECK(strstr(dump.text, " 01 0C 02 000200\n") != 0);
+  
+  FILE *f = fopen("test_trace.txt", "w");
+  fputs(dump.text, f);
+  fclose(f);
+  
+  char  decoded[256] = "";
+  FILE *p = popen("python3 ../trace/decode_trace.py test_trace.txt 2>/dev/null", "r");
+  size_t length = p ? fread(decoded, 1, sizeof(decoded) - 1, p) : 0;
+  decoded[length] = 0;
+  if(p) pclose(p);
+  remove("test_trace.txt");
+  
+  if(length)
+  {
+    CHECK(strstr(decoded, "-> 0C COUNT_FILES") != 0);
+    CHECK(strstr(decoded, "<- 0C COUNT_FILES") != 0);
+    CHECK(strstr(decoded, "len 2 [00 02]") != 0);
+  }
+  else
+  {
+    printf("test_trace: python3 not found, decode_trace.py not checked\n");
+  }
+#endif
+  
+  return testResult("test_trace");
+}
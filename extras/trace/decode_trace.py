@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+Decode the output of JQ8400_Serial::dumpTrace() into something readable.
+
+Usage:
+
+    decode_trace.py [trace.txt]          (or pipe the trace to stdin)
+
+Each line of the dump is "TIME FLAGS COMMAND LENGTH DATA" in hex, as
+printed by dumpTrace(), other lines (eg your own Serial.print output) are
+passed through unchanged.  Command names are taken from the MP3_CMD_...
+constants in src/JQ8400_Serial.h so they are always up to date.
+
+@author James Sleeman, http://sparks.gogo.co.nz/
+@license MIT License
+"""
+
+import os
+import re
+import sys
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'src', 'JQ8400_Serial.h')
+
+TRACE_RX           = 0x01
+TRACE_BAD_CHECKSUM = 0x02
+TRACE_TIMEOUT      = 0x04
+
+LINE = re.compile(r'^\s*([0-9A-Fa-f]{1,4}) ([0-9A-Fa-f]{2}) ([0-9A-Fa-f]{2}) ([0-9A-Fa-f]{2}) ([0-9A-Fa-f]{6})\s*$')
+
+
+def command_names(header):
+    """Map command byte to name(s) from the MP3_CMD_ constants."""
+    names = {}
+    with open(header) as f:
+        for m in re.finditer(r'static const uint8_t (MP3_CMD_\w+)\s*=\s*(0x[0-9A-Fa-f]+|\d+)', f.read()):
+            name, value = m.group(1), int(m.group(2), 0)
+            if name == 'MP3_CMD_BEGIN':
+                continue
+            names.setdefault(value, []).append(name[len('MP3_CMD_'):])
+    return {k: '/'.join(v) for k, v in names.items()}
+
+
+def main():
+    names = command_names(HEADER)
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+
+    last = None
+    for line in source:
+        m = LINE.match(line)
+        if not m:
+            sys.stdout.write(line)
+            continue
+
+        time, flags, command, length = (int(g, 16) for g in m.groups()[:4])
+        data = bytes.fromhex(m.group(5))[:min(length, 3)]
+
+        # The time is the low 16 bits of millis() so we show the difference
+        delta = '' if last is None else '+%dms' % ((time - last) & 0xFFFF)
+        last = time
+
+        direction = '<-' if flags & TRACE_RX else '->'
+        name = names.get(command, 'UNKNOWN')
+
+        if flags & TRACE_TIMEOUT:
+            detail = 'TIMEOUT waiting for response'
+        else:
+            detail = 'len %d [%s%s]' % (length, data.hex(' ').upper(), ' ...' if length > 3 else '')
+            if flags & TRACE_BAD_CHECKSUM:
+                detail += ' BAD CHECKSUM'
+
+        print('%5d %-8s %s %02X %-20s %s' % (time, delta, direction, command, name, detail))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,311 @@
+/** 
+ * Manager for several JQ8400 MP3 Modules
+ * 
+ * Copyright (C) 2019 James Sleeman, <http://sparks.gogo.co.nz/jq6500/index.html>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ * 
+ * @author James Sleeman, http://sparks.gogo.co.nz/
+ * @license MIT License
+ * @file
+ */
+
+
+#include <Arduino.h>
+#include "JQ8400_Fleet.h"
+
+uint8_t JQ8400_Fleet::add(JQ8400_Serial &player)
+{
+  if(this->count >= MP3_FLEET_MAX) return 0;
+  
+  this->players[this->count] = &player;
+  memset(&this->stats[this->count], 0, sizeof(MP3FleetStats));
+  this->count++;
+  return 1;
+}
+
+void JQ8400_Fleet::play()
+{
+  this->sendAll(JQ8400_Serial::MP3_CMD_PLAY, 0, 0);
+}
+
+void JQ8400_Fleet::pause()
+{
+  this->sendAll(JQ8400_Serial::MP3_CMD_PAUSE, 0, 0);
+}
+
+void JQ8400_Fleet::stop()
+{
+  this->sendAll(JQ8400_Serial::MP3_CMD_STOP, 0, 0);
+}
+
+void JQ8400_Fleet::next()
+{
+  this->sendAll(JQ8400_Serial::MP3_CMD_NEXT, 0, 0);
+}
+
+void JQ8400_Fleet::prev()
+{
+  this->sendAll(JQ8400_Serial::MP3_CMD_PREV, 0, 0);
+}
+
+void JQ8400_Fleet::playFileByIndexNumber(uint16_t fileNumber)
+{
+  uint8_t buf[2] = { (uint8_t)(fileNumber >> 8), (uint8_t)fileNumber };
+  this->sendAll(JQ8400_Serial::MP3_CMD_PLAY_IDX, buf, sizeof(buf));
+}
+
+void JQ8400_Fleet::setVolume(byte volumeFrom0To30)
+{
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    this->players[x]->currentVolume = volumeFrom0To30;
+  }
+  this->sendAll(JQ8400_Serial::MP3_CMD_VOL_SET, &volumeFrom0To30, 1);
+}
+
+uint8_t JQ8400_Fleet::syncPlay(uint16_t fileNumber, uint16_t *skews)
+{
+  if(!this->count) return 0;
+  
+  JQ8400_Serial &clock = *this->players[0];
+  
+  // The same frame goes to everybody, so make it just once
+  uint8_t frame[6] = { JQ8400_Serial::MP3_CMD_BEGIN, JQ8400_Serial::MP3_CMD_PLAY_IDX, 2, (uint8_t)(fileNumber >> 8), (uint8_t)fileNumber, 0 };
+  for(uint8_t x = 0; x < 5; x++) frame[5] += frame[x];
+  
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    this->players[x]->prepareToSend();
+  }
+  
+  // Fire, nothing else in between
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    this->players[x]->_Serial->write(frame, sizeof(frame));
+  }
+  
+  uint32_t sentAt = clock.clockMillis();
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    this->players[x]->frameSent(frame[1], frame + 3, 2);
+  }
+  
+  // Keep asking until everybody says they are playing, each is taken to 
+  //  have started when the round of asking in which it was first playing began
+  uint32_t startedAt[MP3_FLEET_MAX];
+  uint8_t  started[MP3_FLEET_MAX] = { };
+  uint8_t  playing = 0;
+  
+  while(playing < this->count && clock.clockMillis() - sentAt < MP3_SYNC_CONFIRM_TIME)
+  {
+    uint16_t statuses[MP3_FLEET_MAX];
+    uint32_t askedAt = clock.clockMillis();
+    
+    this->queryAll(JQ8400_Serial::MP3_CMD_STATUS, statuses, false);
+    
+    for(uint8_t x = 0; x < this->count; x++)
+    {
+      if(started[x] || statuses[x] != MP3_STATUS_PLAYING) continue;
+      
+      started[x]   = 1;
+      startedAt[x] = askedAt;
+      playing++;
+    }
+  }
+  
+  if(skews)
+  {
+    uint32_t first = 0;
+    uint8_t  found = 0;
+    for(uint8_t x = 0; x < this->count; x++)
+    {
+      if(!started[x] || (found && (int32_t)(startedAt[x] - first) >= 0)) continue;
+      first = startedAt[x];
+      found = 1;
+    }
+    
+    for(uint8_t x = 0; x < this->count; x++)
+    {
+      skews[x] = started[x] ? startedAt[x] - first : 0xFFFF;
+    }
+  }
+  
+  return playing;
+}
+
+uint8_t JQ8400_Fleet::getStatus(uint8_t *statuses)
+{
+  uint16_t values[MP3_FLEET_MAX];
+  uint8_t  answered = this->queryAll(JQ8400_Serial::MP3_CMD_STATUS, values, false);
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    statuses[x] = values[x];
+  }
+  return answered;
+}
+
+uint8_t JQ8400_Fleet::countFiles(uint16_t *counts)
+{
+  return this->queryAll(JQ8400_Serial::MP3_CMD_COUNT_FILES, counts, true);
+}
+
+uint8_t JQ8400_Fleet::currentFileIndexNumber(uint16_t *indexes)
+{
+  return this->queryAll(JQ8400_Serial::MP3_CMD_CURRENT_FILE_IDX, indexes, true);
+}
+
+void JQ8400_Fleet::sendAll(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength)
+{
+  // Get every module ready first, so the frames go out back to back
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    this->players[x]->prepareToSend();
+  }
+  
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    this->players[x]->transmitFrame(command, requestBuffer, requestLength);
+  }
+}
+
+uint8_t JQ8400_Fleet::queryAll(uint8_t command, uint16_t *values, uint8_t wide)
+{
+  if(!this->count) return 0;
+  
+  JQ8400_Serial &clock = *this->players[0];
+  
+  uint8_t  responses[MP3_FLEET_MAX][2];
+  uint8_t  status[MP3_FLEET_MAX];
+  uint32_t lastByte[MP3_FLEET_MAX];
+  
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    this->players[x]->prepareToSend();
+  }
+  
+  // Everybody gets asked before we start listening
+  uint32_t sentAt = clock.clockMillis();
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    JQ8400_Serial &p = *this->players[x];
+    
+    memset(responses[x], 0, sizeof(responses[x]));
+    p.rxBuffer       = responses[x];
+    p.rxBufferLength = sizeof(responses[x]);
+    p.rxIndex        = 0;
+    p.rxExpect       = command;
+    
+    p.transmitFrame(command, 0, 0);
+    
+    status[x]   = MP3_RESULT_PENDING;
+    lastByte[x] = sentAt;
+  }
+  
+  // Then take bytes from whichever has them, until all have answered or timed out
+  uint8_t pending = this->count;
+  while(pending)
+  {
+    uint8_t  received = 0;
+    uint32_t now      = clock.clockMillis();
+    
+    for(uint8_t x = 0; x < this->count; x++)
+    {
+      if(status[x] != MP3_RESULT_PENDING) continue;
+      
+      JQ8400_Serial &p = *this->players[x];
+      while(p.inputAvailable())
+      {
+        received    = 1;
+        lastByte[x] = now;
+        
+        uint8_t result = p.parseResponseByte(p.inputRead());
+        if(result == JQ8400_Serial::MP3_FRAME_INCOMPLETE || p.rxCommand != command) continue;
+        
+        status[x] = result == JQ8400_Serial::MP3_FRAME_OK ? MP3_RESULT_OK : MP3_RESULT_CHECKSUM;
+        if(status[x] == MP3_RESULT_OK && p.rxLength != (wide ? 2 : 1)) status[x] = MP3_RESULT_LENGTH;
+        break;
+      }
+      
+      // Time for the device to start responding, then between bytes
+      if(status[x] == MP3_RESULT_PENDING && (now - lastByte[x]) >= p.responseTimeout(command, p.rxIndex))
+      {
+        status[x] = MP3_RESULT_TIMEOUT;
+      }
+      
+      if(status[x] == MP3_RESULT_PENDING) continue;
+      pending--;
+      
+      // Finished with this one
+#if MP3_STATS
+      p.statsResponse(command, status[x]);
+#endif
+      MP3FleetStats &s = this->stats[x];
+      switch(status[x])
+      {
+        case MP3_RESULT_OK:
+          values[x] = wide ? (((uint16_t)responses[x][0] << 8) | responses[x][1]) : responses[x][0];
+#if MP3_CACHE
+          p.cacheStore(command, values[x]);
+#endif
+          
+          s.responses++;
+          s.rttLast   = now - sentAt;
+#if MP3_ADAPTIVE_TIMEOUTS
+          p.timingResponse(command, s.rttLast);
+#endif
+          s.rttTotal += s.rttLast;
+          if(s.rttLast > s.rttMax) s.rttMax = s.rttLast;
+          break;
+          
+        case MP3_RESULT_CHECKSUM:
+        case MP3_RESULT_LENGTH:
+          values[x] = 0;
+          s.checksumFailures++;
+          break;
+          
+        default:
+          values[x] = 0;
+          s.timeouts++;
+#if MP3_ADAPTIVE_TIMEOUTS
+          p.timingTimeout(command);
+#endif
+#if MP3_TRACE
+          p.traceFrame(MP3_TRACE_RX | MP3_TRACE_TIMEOUT, command, 0, 0);
+#endif
+          break;
+      }
+      
+      p.queryResult = status[x];
+      p.rxBuffer    = 0;
+      p.rxExpect    = 0;
+    }
+    
+    // Nothing arrived, give the idle function (or time source) a turn
+    if(!received) clock.idle(1);
+  }
+  
+  uint8_t answered = 0;
+  for(uint8_t x = 0; x < this->count; x++)
+  {
+    if(status[x] == MP3_RESULT_OK) answered++;
+  }
+  
+  return answered;
+}
@@ -0,0 +1,213 @@
+/** 
+ * Manager for several JQ8400 MP3 Modules
+ * 
+ * Copyright (C) 2019 James Sleeman, <http://sparks.gogo.co.nz/jq6500/index.html>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ * 
+ * @author James Sleeman, http://sparks.gogo.co.nz/
+ * @license MIT License
+ * @file
+ */
+
+
+#ifndef JQ8400Fleet_h
+#define JQ8400Fleet_h
+
+#include <Arduino.h>
+#include "JQ8400_Serial.h"
+
+// Maximum number of modules in a fleet
+#ifndef MP3_FLEET_MAX
+  #define MP3_FLEET_MAX 8
+#endif
+
+// How long (ms) syncPlay() waits for every module to confirm it is playing
+#define MP3_SYNC_CONFIRM_TIME 500
+
+/** Statistics for one module of a fleet, see JQ8400_Fleet::getStats()
+ * 
+ *  The average round trip time is rttTotal / responses
+ */
+
+struct MP3FleetStats
+{
+  uint16_t responses;         ///< Number of good responses received
+  uint16_t checksumFailures;  ///< Number of responses with a bad checksum (or the wrong length)
+  uint16_t timeouts;          ///< Number of times the response didn't arrive (completely)
+  uint16_t rttLast;           ///< Round trip time (ms) of the last good response
+  uint16_t rttMax;            ///< Longest round trip time (ms) of good responses
+  uint32_t rttTotal;          ///< Total round trip time (ms) of good responses
+};
+
+/** Drives several JQ8400 modules (each on its own serial port) together.
+ * 
+ *  Asking each module something in turn takes a whole round trip per module,
+ *  the fleet instead writes the command to every module first and then 
+ *  collects the responses from all of them as they arrive, so asking all 
+ *  of them takes about as long as asking one.  Commands are likewise written
+ *  to each module back to back so that they act at (nearly) the same time.
+ * 
+ *  All the modules should use the same time source (see JQ8400_Serial::setTimeSource()).
+ * 
+ * **Example**
+ * 
+ *     JQ8400_Serial zone1(Serial1), zone2(Serial2), zone3(Serial3);
+ *     JQ8400_Fleet  zones;
+ *     
+ *     void setup()
+ *     {
+ *       ...
+ *       zones.add(zone1);
+ *       zones.add(zone2);
+ *       zones.add(zone3);
+ *       
+ *       zones.playFileByIndexNumber(4);
+ *     }
+ *     
+ *     void loop()
+ *     {
+ *       uint8_t statuses[3];
+ *       zones.getStatus(statuses);
+ *       ...
+ *     }
+ * 
+ *  You can of course still use each module on its own as normal.
+ */
+
+class JQ8400_Fleet
+{
+  public:
+    
+    /** Add a module to the fleet.
+     * 
+     * @param player The module, it must remain valid.
+     * @return False if there are already MP3_FLEET_MAX modules.
+     */
+    
+    uint8_t add(JQ8400_Serial &player);
+    
+    /** Number of modules in the fleet. */
+    
+    uint8_t size() { return count; }
+    
+    /** Get a module of the fleet.
+     * 
+     * @param module 0 for the first added, etc
+     */
+    
+    JQ8400_Serial &player(uint8_t module) { return *players[module]; }
+    
+    /** @name Commands
+     * 
+     *  As for the same methods of JQ8400_Serial, but sent to every module.
+     */
+    ///@{
+    
+    void play();
+    void pause();
+    void stop();
+    void next();
+    void prev();
+    void playFileByIndexNumber(uint16_t fileNumber);
+    void setVolume(byte volumeFrom0To30);
+    
+    ///@}
+    
+    /** Start every module playing a file at the same time, as near as we can.
+     * 
+     *  The play frame is made once, every module is readied (anything queued 
+     *  or received dealt with), and then the frame is written to each port 
+     *  back to back with nothing in between.  Then all modules are asked their
+     *  status together, over and over, until all are playing (or 
+     *  MP3_SYNC_CONFIRM_TIME has passed).
+     * 
+     *  The skew of each module is how much later than the first to start it 
+     *  was seen to be playing, measured to the time of one round of status 
+     *  requests (a few ms at 9600 baud).
+     * 
+     * **Example**
+     * 
+     *     uint16_t skews[3];
+     *     if(zones.syncPlay(4, skews) < 3)
+     *     {
+     *       // Someone did not start
+     *     }
+     * 
+     * @param fileNumber FAT index of the file to play, see JQ8400_Serial::playFileByIndexNumber()
+     * @param skews      Array to store the skew (ms) of each module (or NULL), 0xFFFF for those which did not start.
+     * @return Number of modules which were confirmed playing.
+     */
+    
+    uint8_t syncPlay(uint16_t fileNumber, uint16_t *skews = 0);
+    
+    /** @name Queries
+     * 
+     *  As for the same methods of JQ8400_Serial, but asked of every module 
+     *  at once, the answers are stored in an array with an element for each
+     *  module, modules which do not answer give 0.
+     * 
+     *  Each returns the number of modules which answered.
+     */
+    ///@{
+    
+    uint8_t getStatus(uint8_t *statuses);
+    uint8_t countFiles(uint16_t *counts);
+    uint8_t currentFileIndexNumber(uint16_t *indexes);
+    
+    ///@}
+    
+    /** Get the statistics of a module, collected since it was added or resetStats()
+     * 
+     * @param module 0 for the first added, etc
+     */
+    
+    const MP3FleetStats &getStats(uint8_t module) { return stats[module]; }
+    
+    /** Zero all the statistics. */
+    
+    void resetStats() { memset(stats, 0, sizeof(stats)); }
+    
+  protected:
+    
+    /** Send a command, with no response, to every module one after the other.
+     * 
+     * @param command        Byte value of to send as from the datasheet.
+     * @param requestBuffer  Pointer to (or NULL) request data bytes.
+     * @param requestLength  Number of bytes in the request buffer.
+     */
+    
+    void sendAll(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength);
+    
+    /** Send a command to every module and collect the responses together.
+     * 
+     * @param command Byte value of to send as from the datasheet.
+     * @param values  Array of the response of each module, as a 16 bit integer.
+     * @param wide    True if the response is 16 bit, otherwise 8 bit.
+     * @return Number of modules which responded, player(i).lastResult() tells why one didn't.
+     */
+    
+    uint8_t queryAll(uint8_t command, uint16_t *values, uint8_t wide);
+    
+    JQ8400_Serial *players[MP3_FLEET_MAX];
+    uint8_t        count = 0;
+    MP3FleetStats  stats[MP3_FLEET_MAX] = { };
+};
+
+#endif
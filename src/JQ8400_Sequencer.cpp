@@ -0,0 +1,149 @@
+/** 
+ * Gapless Sequencer for JQ8400 MP3 Module
+ * 
+ * Copyright (C) 2019 James Sleeman, <http://sparks.gogo.co.nz/jq6500/index.html>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ * 
+ * @author James Sleeman, http://sparks.gogo.co.nz/
+ * @license MIT License
+ * @file
+ */
+
+
+#include <Arduino.h>
+#include "JQ8400_Sequencer.h"
+
+void JQ8400_Sequencer::start(uint16_t from)
+{
+  this->asking   = 0;
+  this->position = from;
+  if(this->position >= this->count) 
+  {
+    this->state = MP3_SEQUENCER_IDLE;
+    return;
+  }
+  
+  // The device must stop at the end of each file, we choose what's next
+  this->player.setLoopMode(MP3_LOOP_NONE);
+  this->playCurrent();
+}
+
+void JQ8400_Sequencer::stop()
+{
+  this->state = MP3_SEQUENCER_IDLE;
+  this->player.stop();
+}
+
+void JQ8400_Sequencer::playCurrent()
+{
+  this->state = MP3_SEQUENCER_PLAYING;
+  this->player.playFileByIndexNumber(this->files[this->position]);
+  this->predict(false);
+}
+
+void JQ8400_Sequencer::predict(uint8_t askPosition)
+{
+  uint32_t now     = this->player.clockMillis();
+  uint16_t length  = this->player.currentFileLengthInSeconds();
+  uint16_t elapsed = askPosition ? this->player.currentFilePositionInSeconds() : 0;
+  
+  // The length is in whole seconds so the file really ends up to a second 
+  //  after this, we start asking a little before in case of drift
+  this->endAt   = now + (length > elapsed ? (uint32_t)(length - elapsed) * 1000 : 0);
+  this->checkAt = this->endAt - MP3_SEQUENCER_WINDOW;
+  if((int32_t)(this->checkAt - now) < 0) this->checkAt = now;
+}
+
+uint8_t JQ8400_Sequencer::update()
+{
+  this->player.update();
+  
+  if(this->state == MP3_SEQUENCER_IDLE) return 0;
+  
+  uint32_t now = this->player.clockMillis();
+  
+  if(this->asking)
+  {
+    if(this->status.state == MP3_RESULT_PENDING) return 1;
+    this->asking = 0;
+    
+    if(this->status.state == MP3_RESULT_OK)
+    {
+      switch(this->status.value)
+      {
+        case MP3_STATUS_STOPPED:
+          // Finished, on to the next as quick as we can
+          this->position++;
+          if(this->position >= this->count)
+          {
+            if(!this->repeat)
+            {
+              this->state = MP3_SEQUENCER_IDLE;
+              return 0;
+            }
+            this->position = 0;
+          }
+          this->playCurrent();
+          return 1;
+          
+        case MP3_STATUS_PAUSED:
+          // Someone paused it, we can't know when it will end until it resumes
+          this->state   = MP3_SEQUENCER_PAUSED;
+          this->checkAt = now + MP3_SEQUENCER_PAUSED_INTERVAL;
+          return 1;
+          
+        case MP3_STATUS_PLAYING:
+          if(this->state == MP3_SEQUENCER_PAUSED)
+          {
+            this->state = MP3_SEQUENCER_PLAYING;
+            this->predict(true);
+            return 1;
+          }
+          
+          // Well past when it should have ended, the prediction is wrong (seeked?)
+          if((int32_t)(now - this->endAt) > 1000 + MP3_SEQUENCER_WINDOW)
+          {
+            this->predict(true);
+            return 1;
+          }
+          break;
+      }
+    }
+    
+    this->checkAt = now + (this->state == MP3_SEQUENCER_PAUSED ? MP3_SEQUENCER_PAUSED_INTERVAL : MP3_SEQUENCER_INTERVAL);
+    return 1;
+  }
+  
+  if((int32_t)(now - this->checkAt) >= 0)
+  {
+#if MP3_ASYNC
+    this->asking = this->player.requestStatus(&this->status);
+#else
+    // Without the queue (see MP3_ASYNC) we wait for the answer, which is 
+    //  dealt with in the next update() the same as a requested one
+    this->status.value = this->player.getStatus();
+    this->status.state = this->player.lastResult();
+    this->asking       = 1;
+#endif
+    if(this->asking) this->statusPolls++;
+  }
+  
+  return 1;
+}
@@ -0,0 +1,161 @@
+/** 
+ * Gapless Sequencer for JQ8400 MP3 Module
+ * 
+ * Copyright (C) 2019 James Sleeman, <http://sparks.gogo.co.nz/jq6500/index.html>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ * 
+ * @author James Sleeman, http://sparks.gogo.co.nz/
+ * @license MIT License
+ * @file
+ */
+
+
+#ifndef JQ8400Sequencer_h
+#define JQ8400Sequencer_h
+
+#include <Arduino.h>
+#include "JQ8400_Serial.h"
+
+// Polling starts this many ms before the predicted end of the file
+#define MP3_SEQUENCER_WINDOW   300
+
+// And then the status is asked this often (ms)
+#define MP3_SEQUENCER_INTERVAL 20
+
+// While paused, the status is asked this often (ms) to see if it has resumed
+#define MP3_SEQUENCER_PAUSED_INTERVAL 1000
+
+/** Plays a list of files one after the other with as little gap as we can.
+ * 
+ *  Waiting for busy() to go false in a loop asks the device its status 
+ *  continuously, and still leaves a gap of up to the time between asking.
+ *  Instead the sequencer asks the length of each file when it starts and 
+ *  predicts from that when it will end, saying nothing to the device until 
+ *  shortly before then.  Only near the end is the status asked, every 
+ *  MP3_SEQUENCER_INTERVAL ms, and as soon as the device has stopped the 
+ *  next file is played.
+ * 
+ *  The device's own loop mode is set to MP3_LOOP_NONE so that it stops at 
+ *  the end of each file for us to choose the next.
+ * 
+ *  With MP3_ASYNC the status is requested in the background, without it 
+ *  update() waits the few ms for each answer.
+ * 
+ * **Example**
+ * 
+ *     uint16_t         files[] = { 3, 1, 4, 1, 5 };   // FAT index numbers
+ *     JQ8400_Sequencer sequence(mp3, files, 5);
+ *     
+ *     void setup()
+ *     {
+ *       ...
+ *       sequence.start();
+ *     }
+ *     
+ *     void loop()
+ *     {
+ *       sequence.update(); // This calls mp3.update() for you
+ *       // ... do other things, update() only waits while starting the next file
+ *     }
+ * 
+ */
+
+class JQ8400_Sequencer
+{
+  public:
+    
+    /** Create a sequencer.
+     * 
+     * @param player The device to play on.
+     * @param files  FAT index numbers of the files to play (see JQ8400_Serial::playFileByIndexNumber()), it must remain valid.
+     * @param count  Number of files.
+     */
+    
+    JQ8400_Sequencer(JQ8400_Serial &player, const uint16_t *files, uint16_t count) : player(player), files(files), count(count) { }
+    
+    /** Start playing the list.
+     * 
+     * @param from Position in the list to start from (0 is the first file).
+     */
+    
+    void start(uint16_t from = 0);
+    
+    /** Stop playing (the device is stopped too). */
+    
+    void stop();
+    
+    /** Keep the sequence going, call this (instead of JQ8400_Serial::update()) as often as you can.
+     * 
+     * @return True while the sequence is playing.
+     */
+    
+    uint8_t update();
+    
+    /** Go back to the start of the list after the last file.
+     * 
+     * @param repeat True to repeat, False to stop (default)
+     */
+    
+    void setRepeat(uint8_t repeat) { this->repeat = repeat; }
+    
+    /** True while the sequence is playing (or paused). */
+    
+    uint8_t  running()  { return state != MP3_SEQUENCER_IDLE; }
+    
+    /** Position in the list of the file playing. */
+    
+    uint16_t current()  { return position; }
+    
+    /** Number of status requests sent, a measure of the traffic to the device. */
+    
+    uint32_t polls()    { return statusPolls; }
+    
+  protected:
+    
+    /** Play the file at position, and predict when it will end. */
+    
+    void playCurrent();
+    
+    /** Ask the length (and position) of the playing file, and predict when it will end from that.
+     * 
+     * @param askPosition True to ask the position, otherwise it is taken to be the start.
+     */
+    
+    void predict(uint8_t askPosition);
+    
+    static const uint8_t MP3_SEQUENCER_IDLE    = 0; ///< Not playing
+    static const uint8_t MP3_SEQUENCER_PLAYING = 1; ///< Playing a file
+    static const uint8_t MP3_SEQUENCER_PAUSED  = 2; ///< The device was found to be paused
+    
+    JQ8400_Serial  &player;
+    const uint16_t *files;
+    uint16_t        count;
+    uint16_t        position    = 0;
+    uint8_t         repeat      = 0;
+    uint8_t         state       = MP3_SEQUENCER_IDLE;
+    
+    uint32_t        endAt       = 0;  ///< clockMillis() at which the file is predicted to end (at the earliest)
+    uint32_t        checkAt     = 0;  ///< clockMillis() at which to ask the status next
+    MP3Result       status      = { MP3_RESULT_OK, 0, 0 };
+    uint8_t         asking      = 0;  ///< True while waiting for status
+    uint32_t        statusPolls = 0;
+};
+
+#endif
@@ -31,33 +31,33 @@
 
 void  JQ8400_Serial::play()
 {
-  this->sendCommand(MP3_CMD_PLAY);
+  this->sendFixedFrame<MP3_CMD_PLAY>();
 }
 
 void  JQ8400_Serial::restart()
 {
-  this->sendCommand(MP3_CMD_STOP); // Make sure really will restart
-  this->sendCommand(MP3_CMD_PLAY);
+  this->sendFixedFrame<MP3_CMD_STOP>(); // Make sure really will restart
+  this->sendFixedFrame<MP3_CMD_PLAY>();
 }
 
 void  JQ8400_Serial::pause()
 {
-  this->sendCommand(MP3_CMD_PAUSE);
+  this->sendFixedFrame<MP3_CMD_PAUSE>();
 }
 
 void  JQ8400_Serial::stop()
 {
-  this->sendCommand(MP3_CMD_STOP);
+  this->sendFixedFrame<MP3_CMD_STOP>();
 }
 
 void  JQ8400_Serial::next()
 {
-  this->sendCommand(MP3_CMD_NEXT);
+  this->sendFixedFrame<MP3_CMD_NEXT>();
 }
 
 void  JQ8400_Serial::prev()
 {
-  this->sendCommand(MP3_CMD_PREV);
+  this->sendFixedFrame<MP3_CMD_PREV>();
 }
 
 void  JQ8400_Serial::playFileByIndexNumber(uint16_t fileNumber)
@@ -86,7 +86,7 @@ void JQ8400_Serial::abLoopPlay(uint16_t secondsStart, uint16_t secondsEnd)
 
 void JQ8400_Serial::abLoopClear()
 {
-  this->sendCommand(MP3_CMD_AB_PLAY_STOP);
+  this->sendFixedFrame<MP3_CMD_AB_PLAY_STOP>();
 }
 
 void JQ8400_Serial::fastForward(uint16_t seconds)
@@ -103,12 +103,12 @@ void JQ8400_Serial::rewind(uint16_t seconds)
 
 void  JQ8400_Serial::nextFolder()
 {
-  this->sendCommand(MP3_CMD_NEXT_FOLDER);
+  this->sendFixedFrame<MP3_CMD_NEXT_FOLDER>();
 }
 
 void  JQ8400_Serial::prevFolder()
 {
-  this->sendCommand(MP3_CMD_PREV_FOLDER);
+  this->sendFixedFrame<MP3_CMD_PREV_FOLDER>();
 }
 
 void  JQ8400_Serial::playFileNumberInFolderNumber(uint16_t folderNumber, uint16_t fileNumber)
@@ -121,6 +121,13 @@ void  JQ8400_Serial::playFileNumberInFolderNumber(uint16_t folderNumber, uint16_
   //  the basename of the file must have the wildcard also and the extention must be the 
   //  3 question mark character wildcards, you can't even match on ".mp3", damn this is weird
   
+  MP3FolderMapEntry *folder = this->folderMapEntry(folderNumber);
+  if(folder && folder->number != MP3_FOLDER_UNNUMBERED && fileNumber >= folder->number && fileNumber - folder->number < folder->count)
+  {
+    this->playFileByIndexNumber(folder->first + fileNumber - folder->number);
+    return;
+  }
+  
   char buf[] = " /42*/032*???";
   
   buf[0] = this->getSource();
@@ -157,6 +164,13 @@ void  JQ8400_Serial::playFileNumberInFolderNumber(uint16_t folderNumber, uint16_
 
 void  JQ8400_Serial::playInFolderNumber(uint16_t folderNumber)
 {
+  MP3FolderMapEntry *folder = this->folderMapEntry(folderNumber);
+  if(folder)
+  {
+    this->playFileByIndexNumber(folder->first);
+    return;
+  }
+  
   char buf[] = " /42*/*???";
   
   buf[0] = this->getSource();
@@ -175,65 +189,523 @@ void  JQ8400_Serial::playInFolderNumber(uint16_t folderNumber)
   this->sendCommandData(MP3_CMD_PLAY_FILE_FOLDER, (uint8_t*)buf, sizeof(buf)-1, 0, 0);
 }
 
-void JQ8400_Serial::playSequenceByFileNumber(uint8_t playList[], uint8_t listLength)
+uint8_t JQ8400_Serial::buildFolderMap(MP3FolderMapEntry *map, uint8_t mapLength, uint8_t firstFolderNumber)
+{
+  // While the map is empty playInFolderNumber() goes by path, which we want
+  this->folderMap       = map;
+  this->folderMapLength = 0;
+  this->folderMapFirst  = firstFolderNumber;
+  
+  for(uint8_t x = 0; x < mapLength; x++)
+  {
+    map[x].first  = 0;
+    map[x].count  = 0;
+    map[x].number = MP3_FOLDER_UNNUMBERED;
+  }
+  
+  uint16_t total = this->countFiles();
+  if(!total) return 0;
+  
+  // Folders are found by playing them, nobody needs to hear that
+  uint8_t volume = this->currentVolume;
+  this->setVolume(0);
+  
+  uint8_t  found = 0;
+  uint16_t from  = total;
+  for(uint8_t x = 0; x < mapLength; x++)
+  {
+    uint16_t first = this->findFolder(firstFolderNumber + x, from, total);
+    if(!first) continue;
+    from = first;
+    
+    // Playing the folder should have got us to its first file
+    if(this->firstIndexInFolder() != first) continue;
+    uint16_t count = this->countFilesInFolder();
+    if(!count) continue;
+    
+    MP3FolderMapEntry &entry = map[x];
+    entry.first = first;
+    entry.count = count;
+    found++;
+    
+    // The files can be played by index if their names number them in FAT 
+    //  order, which we can only check for the first and last
+    uint16_t number = this->currentFileNumber();
+    if(number == MP3_FOLDER_UNNUMBERED) continue;
+    
+    this->seekFileByIndexNumber(first + count - 1);
+    if(this->currentFileNumber() == number + count - 1) entry.number = number;
+  }
+  
+  this->folderMapLength = mapLength;
+  this->seekFileByIndexNumber(1);
+  this->setVolume(volume);
+  
+  return found;
+}
+
+uint16_t JQ8400_Serial::findFolder(uint16_t folderNumber, uint16_t from, uint16_t total)
+{
+  // If the folder isn't there, the device doesn't go anywhere, so if it 
+  //  stays put, either the folder isn't there or it starts with the file 
+  //  we were at, start from another file to find out which.
+  this->seekFileByIndexNumber(from);
+  this->playInFolderNumber(folderNumber);
+  uint16_t index = this->currentFileIndexNumber();
+  if(index != from) return index;
+  
+  uint16_t other = from == 1 ? total : 1;
+  if(other == from) return 0; // Only one file, can't tell
+  
+  this->seekFileByIndexNumber(other);
+  this->playInFolderNumber(folderNumber);
+  return this->currentFileIndexNumber() == from ? from : 0;
+}
+
+uint16_t JQ8400_Serial::currentFileNumber()
+{
+  // The device reports the name without the dot, eg "006MP3"
+  char name[12];
+  this->currentFileName(name, sizeof(name));
+  
+  uint16_t number = 0;
+  uint8_t  x;
+  for(x = 0; x < 3 && name[x] >= '0' && name[x] <= '9'; x++)
+  {
+    number = number * 10 + (name[x] - '0');
+  }
+  
+  // Up to 3 digits, then not a digit
+  if(!x || (name[x] >= '0' && name[x] <= '9')) return MP3_FOLDER_UNNUMBERED;
+  return number;
+}
+
+MP3FolderMapEntry *JQ8400_Serial::folderMapEntry(uint16_t folderNumber)
+{
+  if(!this->folderMap || folderNumber < this->folderMapFirst) return 0;
+  if(folderNumber - this->folderMapFirst >= this->folderMapLength) return 0;
+  
+  MP3FolderMapEntry *folder = &this->folderMap[folderNumber - this->folderMapFirst];
+  return folder->first ? folder : 0;
+}
+
+uint16_t JQ8400_Serial::buildCatalogue(MP3CatalogueEntry *table, uint16_t tableLength)
+{
+  this->catalogue       = table;
+  this->catalogueLength = 0;
+  
+  uint16_t total = this->countFiles();
+  char     name[12];
+  
+  for(uint16_t index = 1; index <= total && this->catalogueLength < tableLength; index++)
+  {
+    this->seekFileByIndexNumber(index);
+    this->currentFileName(name, sizeof(name));
+    if(!name[0]) continue; // No answer
+    
+    // Insert in order of hash
+    uint16_t hash = fileNameHash(name);
+    uint16_t x    = this->catalogueLength++;
+    for(; x > 0 && table[x-1].hash > hash; x--)
+    {
+      table[x] = table[x-1];
+    }
+    table[x].hash  = hash;
+    table[x].index = index;
+  }
+  
+  this->seekFileByIndexNumber(1);
+  
+  return this->catalogueLength;
+}
+
+uint16_t JQ8400_Serial::saveCatalogue(MP3StoreWriteFunction write, uint16_t address)
+{
+  if(!this->catalogue) return 0;
+  
+  uint16_t files   = this->countFiles();
+  uint8_t  header[7] = { 'J', 'Q', this->getSource(), (uint8_t)(files>>8), (uint8_t)files, (uint8_t)(this->catalogueLength>>8), (uint8_t)this->catalogueLength };
+  uint8_t  sum     = 0;
+  uint16_t a       = address;
+  
+  for(uint8_t x = 0; x < sizeof(header); x++)
+  {
+    write(a++, header[x]);
+    sum += header[x];
+  }
+  
+  for(uint16_t x = 0; x < this->catalogueLength; x++)
+  {
+    uint8_t entry[4] = { (uint8_t)(this->catalogue[x].hash>>8), (uint8_t)this->catalogue[x].hash, (uint8_t)(this->catalogue[x].index>>8), (uint8_t)this->catalogue[x].index };
+    for(uint8_t y = 0; y < sizeof(entry); y++)
+    {
+      write(a++, entry[y]);
+      sum += entry[y];
+    }
+  }
+  
+  write(a++, sum);
+  
+  return a - address;
+}
+
+uint16_t JQ8400_Serial::loadCatalogue(MP3CatalogueEntry *table, uint16_t tableLength, MP3StoreReadFunction read, uint16_t address)
 {
-  char buf[listLength*2+1]; // itoa will need an extra null
+  uint8_t  header[7];
+  uint8_t  sum = 0;
+  uint16_t a   = address;
+  
+  for(uint8_t x = 0; x < sizeof(header); x++)
+  {
+    header[x] = read(a++);
+    sum      += header[x];
+  }
+  
+  uint16_t files  = ((uint16_t)header[3]<<8) | header[4];
+  uint16_t length = ((uint16_t)header[5]<<8) | header[6];
+  
+  if(header[0] != 'J' || header[1] != 'Q' || length > tableLength) return 0;
+  
+  // The media must be the same as when it was saved
+  if(header[2] != this->getSource() || files != this->countFiles()) return 0;
   
-  uint8_t i = 0;
-  for(uint8_t x = 0; x < listLength; x++)
+  for(uint16_t x = 0; x < length; x++)
   {
-    if(playList[x]<10)
+    uint8_t entry[4];
+    for(uint8_t y = 0; y < sizeof(entry); y++)
     {
-      buf[i++] = '0';
+      entry[y] = read(a++);
+      sum     += entry[y];
     }
-    itoa(playList[x], &buf[i++], 10);
+    table[x].hash  = ((uint16_t)entry[0]<<8) | entry[1];
+    table[x].index = ((uint16_t)entry[2]<<8) | entry[3];
+  }
+  
+  if(read(a) != sum) return 0;
+  
+  this->catalogue       = table;
+  this->catalogueLength = length;
+  
+  return length;
+}
+
+uint16_t JQ8400_Serial::fileIndexByName(const char *fileName, uint8_t mayStop)
+{
+  if(!this->catalogue) return 0;
+  
+  uint16_t hash = fileNameHash(fileName);
+  
+  // Find the first entry with this hash
+  uint16_t low  = 0;
+  uint16_t high = this->catalogueLength;
+  while(low < high)
+  {
+    uint16_t mid = (low + high) / 2;
+    if(this->catalogue[mid].hash < hash) low = mid + 1;
+    else high = mid;
+  }
+  
+  if(low >= this->catalogueLength || this->catalogue[low].hash != hash) return 0;
+  
+  // Only one file with this hash, it's ours
+  if(low + 1 >= this->catalogueLength || this->catalogue[low+1].hash != hash) 
+  {
+    return this->catalogue[low].index;
+  }
+  
+  // Different names with the same hash, ask the device which is which, 
+  //  which means seeking to them
+  if(!mayStop) return 0;
+  
+  char name[12];
+  for(; low < this->catalogueLength && this->catalogue[low].hash == hash; low++)
+  {
+    this->seekFileByIndexNumber(this->catalogue[low].index);
+    this->currentFileName(name, sizeof(name));
+    if(fileNameMatches(name, fileName)) return this->catalogue[low].index;
+  }
+  
+  return 0;
+}
+
+uint8_t JQ8400_Serial::playFileByName(const char *fileName)
+{
+  // We are going to stop whatever is playing anyway
+  uint16_t index = this->fileIndexByName(fileName, 1);
+  if(!index) return 0;
+  
+  this->playFileByIndexNumber(index);
+  return 1;
+}
+
+// Names as the device reports them are upper case 8.3 without the dot (and 
+// perhaps padded with spaces), so we ignore those differences
+static const char *fileNameNext(const char *p)
+{
+  while(*p == '.' || *p == ' ') p++;
+  return p;
+}
+
+static const char *fileNameBase(const char *p)
+{
+  const char *slash = strrchr(p, '/');
+  return slash ? slash + 1 : p;
+}
+
+uint16_t JQ8400_Serial::fileNameHash(const char *fileName)
+{
+  // FNV-1a, folded to 16 bits
+  uint32_t hash = 2166136261UL;
+  for(const char *p = fileNameNext(fileNameBase(fileName)); *p; p = fileNameNext(p + 1))
+  {
+    hash ^= (uint8_t)toupper(*p);
+    hash *= 16777619UL;
+  }
+  return (hash >> 16) ^ (hash & 0xFFFF);
+}
+
+uint8_t JQ8400_Serial::fileNameMatches(const char *a, const char *b)
+{
+  a = fileNameNext(fileNameBase(a));
+  b = fileNameNext(fileNameBase(b));
+  
+  while(*a && *b)
+  {
+    if(toupper(*a) != toupper(*b)) return 0;
+    a = fileNameNext(a + 1);
+    b = fileNameNext(b + 1);
+  }
+  
+  return !*a && !*b;
+}
+
+uint16_t JQ8400_Serial::countFilesInFolder()
+{
+  return this->sendCommandWithUnsignedIntResponse(MP3_CMD_COUNT_IN_FOLDER);
+}
+
+uint16_t JQ8400_Serial::countFilesInFolder(uint16_t folderNumber)
+{
+  MP3FolderMapEntry *folder = this->folderMapEntry(folderNumber);
+  return folder ? folder->count : 0;
+}
+
+uint16_t JQ8400_Serial::firstIndexInFolder()
+{
+  return this->sendCommandWithUnsignedIntResponse(MP3_CMD_FIRST_FILE_IN_FOLDER_IDX);
+}
+
+uint16_t JQ8400_Serial::firstIndexInFolder(uint16_t folderNumber)
+{
+  MP3FolderMapEntry *folder = this->folderMapEntry(folderNumber);
+  return folder ? folder->first : 0;
+}
+
+void JQ8400_Serial::playSequenceByFileNumber(uint8_t playList[], uint8_t listLength)
+{
+  // Each file is 2 digits, encoded straight into the frame as it is written
+  uint8_t count = 0;
+  for(uint8_t x = 0; x < listLength && count < MP3_PLAYLIST_FRAME_ENTRIES; x++)
+  {
+    if(playList[x] <= 99) count++;
+  }
+  
+  this->playlist = 0;
+  this->prepareToSend();
+  
+  MP3FrameWriter frame(this->_Serial, MP3_CMD_PLAYLIST, count * 2);
+  for(uint8_t x = 0, n = 0; x < listLength && n < count; x++)
+  {
+    if(playList[x] > 99) continue;
+    frame.put('0' + playList[x] / 10);
+    frame.put('0' + playList[x] % 10);
+    n++;
   }
+  frame.end();
   
-  this->sendCommandData(MP3_CMD_PLAYLIST, (uint8_t *)buf, sizeof(buf)-1, 0, 0);
+  this->frameSent(MP3_CMD_PLAYLIST, 0, count * 2);
+}
+
+// Characters which can be used in the 2 character names of playlist files
+static uint8_t playlistNameValid(const char *fileName)
+{
+  for(uint8_t x = 0; x < 2; x++)
+  {
+    if(!isalnum(fileName[x]) && fileName[x] != '_' && fileName[x] != '-') return 0;
+  }
+  return !fileName[2];
 }
 
 void JQ8400_Serial::playSequenceByFileName(const char * playList[], uint8_t listLength)
 {
-  char buf[listLength*2];
+  uint8_t count = 0;
+  for(uint8_t x = 0; x < listLength && count < MP3_PLAYLIST_FRAME_ENTRIES; x++)
+  {
+    if(playlistNameValid(playList[x])) count++;
+  }
+  
+  this->playlist = 0;
+  this->prepareToSend();
+  
+  MP3FrameWriter frame(this->_Serial, MP3_CMD_PLAYLIST, count * 2);
+  for(uint8_t x = 0, n = 0; x < listLength && n < count; x++)
+  {
+    if(!playlistNameValid(playList[x])) continue;
+    frame.put(playList[x][0]);
+    frame.put(playList[x][1]);
+    n++;
+  }
+  frame.end();
+  
+  this->frameSent(MP3_CMD_PLAYLIST, 0, count * 2);
+}
+
+void JQ8400_Serial::playSequence(JQ8400_Playlist &playList)
+{
+  this->playlist     = &playList;
+  this->playlistSent = 0;
+  this->playlistPart();
+}
+
+void JQ8400_Serial::playlistPart()
+{
+  JQ8400_Playlist *list = this->playlist;
+  
+  uint16_t count = list->count - this->playlistSent;
+  if(count > MP3_PLAYLIST_FRAME_ENTRIES) count = MP3_PLAYLIST_FRAME_ENTRIES;
+  
+  // Sending flushes the queue through update(), which must not check on 
+  //  the playlist meanwhile, nor afterwards act on an answer from before.
+  this->playlistNext      = 0;
+  this->playlistCheckedAt = this->clockMillis();
+  
+  // The list is already in the form the device wants, send it directly
+  this->sendCommandData(MP3_CMD_PLAYLIST, (uint8_t *)&list->names[this->playlistSent * 2], count * 2, 0, 0);
   
-  uint8_t i = 0;
-  for(uint8_t x = 0; x < listLength; x++)
+  this->playlistSent     += count;
+  this->playlistNext      = 0;
+  this->playlistCheckedAt = this->clockMillis();
+#if !MP3_ASYNC
+  this->playlistAsked     = 0;
+#endif
+  
+  // Nothing more to follow
+  if(this->playlistSent >= list->count) this->playlist = 0;
+}
+
+#if MP3_ASYNC
+void JQ8400_Serial::playlistStatus(JQ8400_Serial &player, MP3Result &result)
+{
+  if(player.playlist && result.state == MP3_RESULT_OK && result.value == MP3_STATUS_STOPPED)
   {
-    buf[i++] = playList[x][0];
-    buf[i++] = playList[x][1];
+    player.playlistNext = 1;
   }
+}
+#endif
+
+uint8_t JQ8400_Playlist::addNumber(uint8_t fileNumber)
+{
+  if(fileNumber > 99 || this->count >= this->size) return 0;
+  
+  this->names[this->count * 2]     = '0' + fileNumber / 10;
+  this->names[this->count * 2 + 1] = '0' + fileNumber % 10;
+  this->count++;
+  return 1;
+}
+
+uint8_t JQ8400_Playlist::addName(const char *fileName)
+{
+  if(!playlistNameValid(fileName) || this->count >= this->size) return 0;
   
-  this->sendCommandData(MP3_CMD_PLAYLIST, (uint8_t *)buf, sizeof(buf), 0, 0);
+  this->names[this->count * 2]     = fileName[0];
+  this->names[this->count * 2 + 1] = fileName[1];
+  this->count++;
+  return 1;
 }
 
 void  JQ8400_Serial::volumeUp()
 {
   if(currentVolume < 30) currentVolume++;
-  this->sendCommand(MP3_CMD_VOL_UP); // We still send the command just in case we got out of sync somehow
+  this->sendFixedFrame<MP3_CMD_VOL_UP>(); // We still send the command just in case we got out of sync somehow
 }
 
 void  JQ8400_Serial::volumeDn()
 {
   if(currentVolume > 0 ) currentVolume--;
-  this->sendCommand(MP3_CMD_VOL_DN); // We still send the command just in case we got out of sync somehow
+  this->sendFixedFrame<MP3_CMD_VOL_DN>(); // We still send the command just in case we got out of sync somehow
 }
 
 void  JQ8400_Serial::setVolume(byte volumeFrom0To30)
 {
+  if(this->writeOnChange && (this->shadowValid & MP3_SHADOW_VOLUME) && currentVolume == volumeFrom0To30) return;
+  
   currentVolume = volumeFrom0To30;
-  this->sendCommand(MP3_CMD_VOL_SET, volumeFrom0To30);
+  this->shadowValid |= MP3_SHADOW_VOLUME;
+  this->sendFrame(MP3_CMD_VOL_SET, volumeFrom0To30);
 }
 
 void  JQ8400_Serial::setEqualizer(byte equalizerMode)
 {
+  if(this->writeOnChange && (this->shadowValid & MP3_SHADOW_EQ) && currentEq == equalizerMode) return;
+  
   currentEq = equalizerMode;
-  this->sendCommand(MP3_CMD_EQ_SET, equalizerMode);
+  this->shadowValid |= MP3_SHADOW_EQ;
+  this->sendFrame(MP3_CMD_EQ_SET, equalizerMode);
 }
 
 void  JQ8400_Serial::setLoopMode(byte loopMode)
 {
+  if(this->writeOnChange && (this->shadowValid & MP3_SHADOW_LOOP) && currentLoop == loopMode) return;
+  
   currentLoop = loopMode;
-  this->sendCommand(MP3_CMD_LOOP_SET, loopMode);
+  this->shadowValid |= MP3_SHADOW_LOOP;
+  this->sendFrame(MP3_CMD_LOOP_SET, loopMode);
+}
+
+uint8_t JQ8400_Serial::applyConfig(const MP3Config &config)
+{
+  // In the same order as the MP3_SHADOW_... bits
+  const uint8_t commands[3] = { MP3_CMD_VOL_SET, MP3_CMD_EQ_SET, MP3_CMD_LOOP_SET };
+  const uint8_t values[3]   = { config.volume,   config.equalizer, config.loopMode };
+  uint8_t      *current[3]  = { &this->currentVolume, &this->currentEq, &this->currentLoop };
+  
+  uint8_t frames[3][5];
+  uint8_t count = 0;
+  for(uint8_t x = 0; x < 3; x++)
+  {
+    if((this->shadowValid & (1<<x)) && *current[x] == values[x]) continue;
+    
+    uint8_t *frame = frames[count++];
+    frame[0] = MP3_CMD_BEGIN;
+    frame[1] = commands[x];
+    frame[2] = 1;
+    frame[3] = values[x];
+    frame[4] = frameChecksum(commands[x], 1, values[x]);
+    
+    *current[x]        = values[x];
+    this->shadowValid |= 1<<x;
+  }
+  
+  if(!count) return 0;
+  
+#if MP3_ASYNC
+  // Queued commands must go first, let the usual way deal with that
+  if(this->asyncMode || this->queueCount)
+  {
+    for(uint8_t x = 0; x < count; x++) this->sendFrame(frames[x]);
+    return count;
+  }
+#endif
+  
+  // Otherwise all the frames go in a single write
+  this->prepareToSend();
+  this->_Serial->write(frames[0], count * 5);
+  for(uint8_t x = 0; x < count; x++)
+  {
+    this->frameSent(frames[x][1], frames[x] + 3, 1);
+  }
+  
+  return count;
 }
 
 
@@ -244,7 +716,9 @@ uint8_t JQ8400_Serial::getAvailableSources()
 
 void  JQ8400_Serial::setSource(byte source)
 {
-  this->sendCommand(MP3_CMD_SOURCE_SET, source);
+  this->folderMapLength = 0; // Folders and files of the old source
+  this->catalogueLength = 0;
+  this->sendFrame(MP3_CMD_SOURCE_SET, source);
 }
 
 uint8_t JQ8400_Serial::getSource() 
@@ -263,69 +737,173 @@ void  JQ8400_Serial::sleep()
   //  to be stop, and have defined for sake of convenience the other stop
   //  command as "RESET", we will issue both to be sure
     
-  this->sendCommand(MP3_CMD_SLEEP);
-  this->sendCommand(MP3_CMD_STOP);
+  this->sendFixedFrame<MP3_CMD_SLEEP>();
+  this->sendFixedFrame<MP3_CMD_STOP>();
 }
 
-void  JQ8400_Serial::reset()
+uint8_t JQ8400_Serial::reset(uint16_t *readyTime)
 {
-  uint8_t retry = 5; // Try really hard to make ourselves heard.
-  do
+  uint32_t startTime = this->clockMillis();
+  
+  // The datasheet defined two stop commands but has no reset command
+  //  I have elected to make what looks more like "universal stop" 0x10
+  //  to be stop, and have defined for sake of convenience the other stop
+  //  command as "RESET", we will issue both to be sure and then 
+  //  set things back to "defaults", in absense of an actual reset
+  this->sendFixedFrame<MP3_CMD_STOP>();  this->clockDelay(1); // There seems to be something
+  this->sendFixedFrame<MP3_CMD_RESET>(); this->clockDelay(1); //  related to timing here
+  
+  // Ask until it answers, a device which is still booting ignores us so
+  //  there is no point sending the rest until then.  Each probe is given 
+  //  longer to be answered, and the next is not sent before that time is 
+  //  up even if this one failed quickly, so that a device which is slow to 
+  //  start is not flooded.  An answer which comes too late for one probe is
+  //  only taken if it arrives while we wait for the next, one which arrives 
+  //  between probes is thrown away with any other leftovers before sending.
+  uint8_t  result   = MP3_RESULT_TIMEOUT;
+  uint8_t  answered = 0;
+  uint16_t wait     = MP3_RESET_PROBE_FIRST;
+  uint8_t  sources  = 0;
+  uint32_t waited;
+  while((waited = this->clockMillis() - startTime) < this->resetTimeout)
   {
-    // The datasheet defined two stop commands but has no reset command
-    //  I have elected to make what looks more like "universal stop" 0x10
-    //  to be stop, and have defined for sake of convenience the other stop
-    //  command as "RESET", we will issue both to be sure and then 
-    //  set things back to "defaults", in absense of an actual reset
-    
-    this->sendCommand(MP3_CMD_STOP);  delay(1); // There seems to be something
-    this->sendCommand(MP3_CMD_RESET); delay(1); //  related to timing here
+    uint32_t probeAt = this->clockMillis();
+    uint16_t timeout = wait < this->resetTimeout - waited ? wait : this->resetTimeout - waited;
     
+    this->probeTimeout = timeout;
+    result = this->query(MP3_CMD_GET_SOURCES, &sources, 1, 1);
+    this->probeTimeout = 0;
     
-    // Reset to the startup defaults
-    this->setVolume(20);
-    this->setEqualizer(0);
-    this->setLoopMode(2);
-    this->seekFileByIndexNumber(1);
-    this->sendCommand(MP3_CMD_STOP);
-    
-    uint8_t timeout = 9;
-    while(timeout-- > 0 )
+    if(result == MP3_RESULT_OK)
     {
-      if(getAvailableSources())
-      {
-        retry = 0;
-        break; 
-      }
-      delay(1);
+      if(sources) break;
+      
+      // It's up, but has no media (yet, a card may still be starting)
+      answered = 1;
     }
+    
+    uint32_t took = this->clockMillis() - probeAt;
+    if(took < timeout) this->clockDelay(timeout - took);
+    
+    if(wait < MP3_RESET_PROBE_MAX) wait *= 2;
   }
-  while(retry-- > 0);
+  
+  if(result != MP3_RESULT_OK || !sources) 
+  {
+    result = answered ? MP3_RESULT_NO_SOURCES : MP3_RESULT_TIMEOUT;
+  }
+  
+  this->queryResult = result;
+  if(readyTime) *readyTime = this->clockMillis() - startTime;
+  if(result == MP3_RESULT_TIMEOUT) return result;
+  
+  // Reset to the startup defaults, whatever we think it already has
+  this->markDirty();
+  this->setVolume(20);
+  this->setEqualizer(0);
+  this->setLoopMode(2);
+  this->seekFileByIndexNumber(1);
+  this->sendFixedFrame<MP3_CMD_STOP>();
+  
+  return result;
 }
 
 
     byte  JQ8400_Serial::getStatus()    
     {
-      if(MP3_STATUS_CHECKS_IN_AGREEMENT <= 1)
+      // The pin can only tell us it is playing, paused and stopped look the same
+      if(this->busyPin != MP3_NO_PIN && this->readBusyPin())
       {
-        return this->sendCommandWithByteResponse(MP3_CMD_STATUS); 
+        this->queryResult = MP3_RESULT_OK;
+        return MP3_STATUS_PLAYING;
       }
       
-      byte statTotal = 0;
-      byte stat       = 0;
-      do
+      this->queryCorrupted = 0;
+      byte stat = this->sendCommandWithByteResponse(MP3_CMD_STATUS);
+      
+      // Normally the one answer is good enough, but once we have seen a 
+      //  corrupted response the line is evidently noisy and a bad one might 
+      //  also get past the checksum, so ask again until enough agree.
+      if(!this->queryCorrupted || MP3_STATUS_CHECKS_IN_AGREEMENT <= 1) return stat;
+      
+#if MP3_CACHE
+      // That one answer went in the cache, it's not to be trusted until the 
+      //  vote agrees with it
+      this->cache[MP3_CACHE_STATUS].valid = 0;
+#endif
+      
+      uint8_t agree    = this->queryResult == MP3_RESULT_OK ? 1 : 0;
+      uint8_t attempts = MP3_STATUS_CHECKS_IN_AGREEMENT * 2;
+      while(agree < MP3_STATUS_CHECKS_IN_AGREEMENT && attempts--)
       {
-        statTotal = 0;
-        for(byte x = 0; x < MP3_STATUS_CHECKS_IN_AGREEMENT; x++)
+        // Direct, not from the cache, which would of course agree
+        uint8_t again;
+        uint8_t result = this->query(MP3_CMD_STATUS, &again, 1, 1);
+        if(result == MP3_RESULT_TIMEOUT) break;
+        if(result != MP3_RESULT_OK)      continue;
+        
+        if(agree && again == stat) 
         {
-          stat = this->sendCommandWithByteResponse(MP3_CMD_STATUS);      
-          if(stat == 0) return 0; // STOP is fairly reliable
-          statTotal += stat;
+          agree++;
         }
-
-      } while (statTotal != 1 * MP3_STATUS_CHECKS_IN_AGREEMENT && statTotal != 2 * MP3_STATUS_CHECKS_IN_AGREEMENT);
+        else
+        {
+          stat  = again;
+          agree = 1;
+        }
+      }
+      
+      if(agree < MP3_STATUS_CHECKS_IN_AGREEMENT)
+      {
+        // Couldn't get a consistent answer, report it as corrupt
+        if(this->queryResult == MP3_RESULT_OK) this->queryResult = MP3_RESULT_CHECKSUM;
+        return 0;
+      }
+      
+      this->queryResult = MP3_RESULT_OK;
+#if MP3_CACHE
+      this->cacheStore(MP3_CMD_STATUS, stat);
+#endif
+      return stat;
+    }
+    
+    uint8_t JQ8400_Serial::busy()
+    {
+      if(this->busyPin != MP3_NO_PIN) return this->readBusyPin();
+      
+      return this->getStatus() == MP3_STATUS_PLAYING;
+    }
+    
+    void JQ8400_Serial::setBusyPin(uint8_t pin, uint8_t activeLevel, MP3PinReadFunction readFunction)
+    {
+      this->busyPin         = pin;
+      this->busyActiveLevel = activeLevel;
+      this->busyRead        = readFunction;
+      if(pin == MP3_NO_PIN) return;
+      
+      if(!readFunction) pinMode(pin, INPUT);
+      this->busyWasActive = (readFunction ? readFunction(pin) : digitalRead(pin)) == activeLevel;
+    }
+    
+    uint8_t JQ8400_Serial::readBusyPin()
+    {
+      uint8_t active = (this->busyRead ? this->busyRead(this->busyPin) : digitalRead(this->busyPin)) == this->busyActiveLevel;
+      if(active == this->busyWasActive) return active;
+      
+      this->busyWasActive = active;
+      
+#if MP3_CACHE
+      // The device changed on its own, perhaps to another file
+      this->cache[MP3_CACHE_STATUS].valid     = 0;
+      this->cache[MP3_CACHE_FILE_INDEX].valid = 0;
+#endif
       
-      return statTotal / MP3_STATUS_CHECKS_IN_AGREEMENT;      
+      if(!active && this->finishedCallback && this->clockMillis() - this->playChangedAt >= MP3_BUSY_SETTLE_TIME)
+      {
+        this->finishedCallback(*this);
+      }
+      
+      return active;
     }
     
     byte  JQ8400_Serial::getVolume()    { return currentVolume; }
@@ -345,22 +923,48 @@ void  JQ8400_Serial::reset()
     
     uint16_t  JQ8400_Serial::currentFilePositionInSeconds() 
     {
+      // When subscribed the device tells us every second anyway, we just
+      //  need to read whatever has arrived.
+      if(this->positionSubscribed)
+      {
+        this->update();
+        return this->position;
+      }
+      
       uint8_t buf[3];
       
       // This turns on continuous position reporting, every second
-      this->sendCommandData(MP3_CMD_CURRENT_FILE_POS, 0, 0, buf, 3);
+      this->query(MP3_CMD_CURRENT_FILE_POS, buf, 3, 3);
       
       // Stop it doing that
-      this->sendCommand(MP3_CMD_CURRENT_FILE_POS_STOP);
+      this->sendFixedFrame<MP3_CMD_CURRENT_FILE_POS_STOP>();
       
       return (buf[0]*60*60) + (buf[1]*60) + buf[2];
     }
     
+    void JQ8400_Serial::subscribePosition(MP3PositionCallback onPosition)
+    {
+      this->positionCallback   = onPosition;
+      this->positionSubscribed = 1;
+      
+      // The device responds immediately with the current position, which 
+      //  frameReceived() takes care of, and then again every second.
+      uint8_t buf[3];
+      this->sendCommandData(MP3_CMD_CURRENT_FILE_POS, 0, 0, buf, sizeof(buf));
+    }
+    
+    void JQ8400_Serial::unsubscribePosition()
+    {
+      this->positionSubscribed = 0;
+      this->positionCallback   = 0;
+      this->sendFixedFrame<MP3_CMD_CURRENT_FILE_POS_STOP>();
+    }
+    
     uint16_t  JQ8400_Serial::currentFileLengthInSeconds()   
     {
       uint8_t buf[3];
       
-      this->sendCommandData(MP3_CMD_CURRENT_FILE_LEN, 0, 0, buf, 3);
+      this->query(MP3_CMD_CURRENT_FILE_LEN, buf, 3, 3);
       
       return (buf[0]*60*60) + (buf[1]*60) + buf[2];
       
@@ -370,7 +974,7 @@ void  JQ8400_Serial::reset()
     void          JQ8400_Serial::currentFileName(char *buffer, uint16_t bufferLength) 
     {
       // this->sendCommand(MP3_CMD_CURRENT_FILE_NAME, 0, 0, buffer, bufferLength);
-      this->sendCommand(MP3_CMD_CURRENT_FILE_NAME, (uint8_t *)buffer, bufferLength);
+      this->query(MP3_CMD_CURRENT_FILE_NAME, (uint8_t *)buffer, bufferLength, 0);
       buffer[bufferLength-1] = 0; // Ensure null termination since this is a string.
     }
     
@@ -378,55 +982,166 @@ void  JQ8400_Serial::reset()
     // and take no arguments
     uint16_t JQ8400_Serial::sendCommandWithUnsignedIntResponse(byte command)
     {      
-      uint8_t buffer[4];
-      this->sendCommand(command, buffer, sizeof(buffer));
-      return ((uint8_t)buffer[0]<<8) | ((uint8_t)buffer[1]);
+      uint16_t value;
+#if MP3_CACHE
+      if(this->cacheLookup(command, &value)) return value;
+#endif
+      
+      uint8_t buffer[2];
+      if(this->query(command, buffer, sizeof(buffer), 2) != MP3_RESULT_OK) return 0;
+      
+      value = ((uint8_t)buffer[0]<<8) | ((uint8_t)buffer[1]);
+#if MP3_CACHE
+      this->cacheStore(command, value);
+#endif
+      return value;
     }
     
     uint8_t JQ8400_Serial::sendCommandWithByteResponse(uint8_t command)
     {
+#if MP3_CACHE
+      uint16_t cached;
+      if(this->cacheLookup(command, &cached)) return cached;
+#endif
+      
       uint8_t response = 0;
-      this->sendCommand(command, &response, 1);
+      if(this->query(command, &response, 1, 1) != MP3_RESULT_OK) return 0;
+      
+#if MP3_CACHE
+      this->cacheStore(command, response);
+#endif
       return response;
     }
     
-    void  JQ8400_Serial::sendCommandData(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength, uint8_t *responseBuffer, uint8_t bufferLength)
+    uint8_t JQ8400_Serial::query(uint8_t command, uint8_t *responseBuffer, uint8_t bufferLength, uint8_t expectLength)
     {
-      // Calculate the checksum which forms the end byte
-      uint8_t MP3_CHECKSUM = MP3_CMD_BEGIN + command + requestLength;
+      uint8_t attempt = 0;
+      this->queryCorrupted = 0;
+      do
+      {
+        this->queryResult = this->sendCommandData(command, 0, 0, responseBuffer, bufferLength, expectLength);
+        if(this->queryResult == MP3_RESULT_CHECKSUM || this->queryResult == MP3_RESULT_LENGTH) this->queryCorrupted++;
+      } while(this->queryResult != MP3_RESULT_OK && attempt++ < this->queryRetries);
       
-      for(uint8_t x = 0; x < requestLength; x++)
+      return this->queryResult;
+    }
+    
+#if MP3_CACHE
+    void JQ8400_Serial::setCacheTime(uint8_t query, uint16_t maxAge)
+    {
+      if(query >= MP3_CACHE_QUERIES) return;
+      this->cache[query].maxAge = maxAge;
+      this->cache[query].valid  = 0;
+    }
+    
+    void JQ8400_Serial::clearCache()
+    {
+      for(uint8_t x = 0; x < MP3_CACHE_QUERIES; x++)
       {
-        MP3_CHECKSUM += (uint8_t)requestBuffer[x];
+        this->cache[x].valid = 0;
       }
+    }
+    
+    uint8_t JQ8400_Serial::cacheQuery(uint8_t command)
+    {
+      switch(command)
+      {
+        case MP3_CMD_STATUS:           return MP3_CACHE_STATUS;
+        case MP3_CMD_GET_SOURCE:       return MP3_CACHE_SOURCE;
+        case MP3_CMD_GET_SOURCES:      return MP3_CACHE_SOURCES;
+        case MP3_CMD_COUNT_FILES:      return MP3_CACHE_COUNT_FILES;
+        case MP3_CMD_CURRENT_FILE_IDX: return MP3_CACHE_FILE_INDEX;
+      }
+      return MP3_CACHE_QUERIES;
+    }
+    
+    uint8_t JQ8400_Serial::cacheLookup(uint8_t command, uint16_t *value)
+    {
+      uint8_t query = this->cacheQuery(command);
+      if(query >= MP3_CACHE_QUERIES || !this->cache[query].maxAge) return 0;
       
-#if MP3_DEBUG
-      Serial.println();
+      MP3CacheEntry &c = this->cache[query];
+      if(c.valid && (this->clockMillis() - c.time) < c.maxAge)
+      {
+        c.hits++;
+        *value = c.value;
+        this->queryResult = MP3_RESULT_OK;
+        return 1;
+      }
       
-      HEX_PRINT(MP3_CMD_BEGIN);  Serial.print(" ");
-      HEX_PRINT(command);        Serial.print(" ");
-      HEX_PRINT(requestLength);  Serial.print(" ");
+      c.misses++;
+      return 0;
+    }
+    
+    void JQ8400_Serial::cacheStore(uint8_t command, uint16_t value)
+    {
+      uint8_t query = this->cacheQuery(command);
+      if(query >= MP3_CACHE_QUERIES || !this->cache[query].maxAge) return;
       
-      for(uint8_t x = 0; x < requestLength; x++)
+      MP3CacheEntry &c = this->cache[query];
+      c.value = value;
+      c.time  = this->clockMillis();
+      c.valid = 1;
+    }
+    
+    void JQ8400_Serial::cacheInvalidate(uint8_t command)
+    {
+      // Which answers could the command have changed
+      uint8_t changes = 0;
+      switch(command)
       {
-          HEX_PRINT(requestBuffer[x]); 
-          Serial.print(' ');
+        case MP3_CMD_PLAY:
+        case MP3_CMD_PAUSE:
+        case MP3_CMD_STOP:
+          changes = 1<<MP3_CACHE_STATUS;
+          break;
+          
+        case MP3_CMD_NEXT:
+        case MP3_CMD_PREV:
+        case MP3_CMD_PLAY_IDX:
+        case MP3_CMD_SEEK_IDX:
+        case MP3_CMD_INSERT_IDX:
+        case MP3_CMD_NEXT_FOLDER:
+        case MP3_CMD_PREV_FOLDER:
+        case MP3_CMD_PLAYLIST:
+        case MP3_CMD_PLAY_FILE_FOLDER:
+          changes = (1<<MP3_CACHE_STATUS) | (1<<MP3_CACHE_FILE_INDEX);
+          break;
+          
+        case MP3_CMD_SOURCE_SET:
+          changes = (1<<MP3_CACHE_STATUS) | (1<<MP3_CACHE_FILE_INDEX) | (1<<MP3_CACHE_SOURCE) | (1<<MP3_CACHE_COUNT_FILES);
+          break;
+          
+        case MP3_CMD_RESET: // Also MP3_CMD_SLEEP
+          changes = (1<<MP3_CACHE_QUERIES) - 1;
+          break;
       }
       
-      HEX_PRINT(MP3_CHECKSUM);  Serial.print(" ");
+      for(uint8_t x = 0; x < MP3_CACHE_QUERIES; x++, changes >>= 1)
+      {
+        if(changes & 1) this->cache[x].valid = 0;
+      }
+    }
 #endif
-      
-      // If there is any random garbage on the line, clear that out now.
-      while(this->waitUntilAvailable(10)) this->_Serial->read();
-
-      this->_Serial->write(MP3_CMD_BEGIN);
-      this->_Serial->write(command);
-      this->_Serial->write(requestLength);
-      for(uint8_t x = 0; x < requestLength; x++)
+    
+    uint8_t JQ8400_Serial::sendCommandData(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength, uint8_t *responseBuffer, uint8_t bufferLength, uint8_t expectLength)
+    {
+#if MP3_ASYNC
+      // In async mode, commands which we don't need a response to just go 
+      //  into the queue for update() to send when it gets to them.
+      if(this->asyncMode && !(responseBuffer && bufferLength) && requestLength <= MP3_QUEUE_DATA_LENGTH)
       {
-          this->_Serial->write(requestBuffer[x]);
+        while(!this->queueCommand(command, requestBuffer, requestLength, MP3_RESPONSE_NONE, 0, 0))
+        {
+          // Queue is full, we have no choice but to wait for some room
+          this->updateWaiting();
+        }
+        return MP3_RESULT_OK;
       }
-      this->_Serial->write(MP3_CHECKSUM);
+#endif
+      
+      this->prepareToSend();
+      this->transmitFrame(command, requestBuffer, requestLength);
             
       if(responseBuffer && bufferLength) 
       {
@@ -436,109 +1151,770 @@ void  JQ8400_Serial::reset()
       // If we don't expect a response (or don't care) don't wait for ones
       else
       {
-        return;
+        return MP3_RESULT_OK;
       }
       
       // Allow some time for the device to process what we did and 
       // respond, up to 1 second, but typically only a few ms.
-      this->waitUntilAvailable(1000);
+      
+      // The response format is the same as the command format
+      //  AA [CMD] [DATA_COUNT] [B1..N] [SUM]
+      //
+      // The frame tells us how long it is, so we stop reading as soon as the 
+      // checksum byte has been consumed, anything after that stays in the 
+      // stream for whoever reads next.
+      this->rxBuffer       = responseBuffer;
+      this->rxBufferLength = bufferLength;
+      this->rxIndex        = 0;
+      this->rxExpect       = command;
+      
+      uint8_t      result = MP3_FRAME_INCOMPLETE;
+      while(1)
+      {
+        // Between frames we are waiting for the first byte of ours, that 
+        //  wait runs from when we sent the command so that frames the device 
+        //  sends on its own (eg position reports) don't keep restarting it
+        uint16_t timeout = this->responseTimeout(command, this->rxIndex);
+        if(!this->rxIndex)
+        {
+          uint32_t waited = this->clockMillis() - this->sentAt;
+          timeout = waited < timeout ? timeout - waited : 0;
+        }
+        
+        if(!this->waitUntilAvailable(timeout)) break;
+        
+        result = this->parseResponseByte(this->inputRead());
+        if(result == MP3_FRAME_INCOMPLETE) continue;
+        
+        // A frame for a different command is not our response, keep waiting
+        if(this->rxCommand == command) break;
+        result = MP3_FRAME_INCOMPLETE;
+      }
+      
+      uint8_t status = result == MP3_FRAME_OK ? MP3_RESULT_OK : (result == MP3_FRAME_BAD_CHECKSUM ? MP3_RESULT_CHECKSUM : MP3_RESULT_TIMEOUT);
+      
+      // A corrupted length byte can still add up, if so the data is not what it seems
+      if(status == MP3_RESULT_OK && expectLength && this->rxLength != expectLength)
+      {
+        status = MP3_RESULT_LENGTH;
+      }
+      
+#if MP3_STATS
+      this->statsResponse(command, status);
+#endif
+      
+#if MP3_ADAPTIVE_TIMEOUTS
+      if(result == MP3_FRAME_OK)         this->timingResponse(command, this->clockMillis() - this->sentAt);
+      if(result == MP3_FRAME_INCOMPLETE) this->timingTimeout(command);
+#endif
+      
+      if(status != MP3_RESULT_OK)
+      {
+        // Checksum failed, wrong length, or the frame never completed
+        memset(responseBuffer, 0, bufferLength);
+      }
+      
+#if MP3_TRACE
+      if(result == MP3_FRAME_INCOMPLETE) this->traceFrame(MP3_TRACE_RX | MP3_TRACE_TIMEOUT, command, 0, 0);
+#endif
+      
+      this->rxBuffer = 0;
+      this->rxExpect = 0;
+      
+      return status;
+    }
+    
+    uint8_t JQ8400_Serial::parseResponseByte(uint8_t c)
+    {
+#if MP3_STATS
+      this->stats.bytesReceived++;
+#endif
+      
+      switch(this->rxIndex)
+      {
+        case 0:
+          // Anything before the start byte is garbage, skip it
+          if(c != MP3_CMD_BEGIN) 
+          {
+#if MP3_STATS
+            this->stats.garbageBytes++;
+#endif
+            return MP3_FRAME_INCOMPLETE;
+          }
+          this->rxChecksum = c;
+          this->rxIndex++;
+          return MP3_FRAME_INCOMPLETE;
+          
+        case 1:
+          this->rxCommand  = c;
+          this->rxChecksum += c;
+          this->rxIndex++;
+          return MP3_FRAME_INCOMPLETE;
+          
+        case 2:
+          // The number of data bytes to read
+          this->rxLength   = c;
+          this->rxChecksum += c;
+          this->rxIndex++;
+          return MP3_FRAME_INCOMPLETE;
+      }
+      
+      if((uint8_t)(this->rxIndex - 3) < this->rxLength)
+      {
+        // This is a data byte, we only record as many as will fit, and only
+        //  in the caller's buffer if it is the response they are waiting for
+        if(this->rxBuffer && this->rxCommand == this->rxExpect && (uint8_t)(this->rxIndex - 3) < this->rxBufferLength)
+        {
+          this->rxBuffer[this->rxIndex-3] = c;
+        }
+        if((uint8_t)(this->rxIndex - 3) < sizeof(this->rxData))
+        {
+          this->rxData[this->rxIndex-3] = c;
+        }
+        this->rxChecksum += c;
+        this->rxIndex++;
+        return MP3_FRAME_INCOMPLETE;
+      }
+      
+      // This is the checksum byte, the frame is complete
+      this->rxIndex = 0;
+      
+#if MP3_TRACE
+      this->traceFrame(MP3_TRACE_RX | (this->rxChecksum == c ? 0 : MP3_TRACE_BAD_CHECKSUM), this->rxCommand, this->rxData, this->rxLength);
+#endif
+      
+      if(this->rxChecksum != c) return MP3_FRAME_BAD_CHECKSUM;
+      
+      this->frameReceived();
+      return MP3_FRAME_OK;
+    }
+    
 
+    void JQ8400_Serial::frameReceived()
+    {
+      // Position reports arrive every second once turned on, whether it was
+      //  asked for or not we may as well note the position.
+      if(this->rxCommand == MP3_CMD_CURRENT_FILE_POS && this->rxLength >= 3)
+      {
+        this->position = (this->rxData[0]*60*60) + (this->rxData[1]*60) + this->rxData[2];
+        if(this->positionCallback) this->positionCallback(*this, this->position);
+      }
       
-#if MP3_DEBUG
-      Serial.print(" ==> [");
+      // The response being waited for is dealt with by the waiter
+      if(this->rxCommand == this->rxExpect) return;
+      
+      uint8_t handled = (this->rxCommand == MP3_CMD_CURRENT_FILE_POS);
+#if !MP3_ASYNC
+      // The answer to the status update() asked for while a playlist plays
+      if(this->rxCommand == MP3_CMD_STATUS && this->playlistAsked)
+      {
+        if(this->playlist && this->rxLength >= 1 && this->rxData[0] == MP3_STATUS_STOPPED) this->playlistNext = 1;
+        this->playlistAsked = 0;
+        handled = 1;
+      }
+#endif
+#if MP3_FRAME_HANDLERS
+      for(uint8_t x = 0; x < MP3_FRAME_HANDLERS; x++)
+      {
+        MP3FrameHandlerEntry &h = this->frameHandlers[x];
+        if(!h.handler) continue;
+        if(h.command != MP3_FRAME_ANY && h.command != this->rxCommand) continue;
+        
+        h.handler(*this, this->rxCommand, this->rxData, this->rxLength);
+        handled = 1;
+      }
 #endif
       
-      // The response format is the same as the command format
-      //  AA [CMD] [DATA_COUNT] [B1..N] [SUM]
-      MP3_CHECKSUM = 0;
+#if MP3_STATS
+      if(!handled) this->stats.garbageBytes += this->rxLength + 4;
+#else
+      (void)handled;
+#endif
+    }
+    
+#if MP3_FRAME_HANDLERS
+    uint8_t JQ8400_Serial::onFrame(uint8_t command, MP3FrameHandler handler)
+    {
+      // Replace (or remove) an existing handler for this command
+      for(uint8_t x = 0; x < MP3_FRAME_HANDLERS; x++)
+      {
+        if(this->frameHandlers[x].handler && this->frameHandlers[x].command == command)
+        {
+          this->frameHandlers[x].handler = handler;
+          return 1;
+        }
+      }
+      
+      if(!handler) return 1;
+      
+      for(uint8_t x = 0; x < MP3_FRAME_HANDLERS; x++)
+      {
+        if(!this->frameHandlers[x].handler)
+        {
+          this->frameHandlers[x].command = command;
+          this->frameHandlers[x].handler = handler;
+          return 1;
+        }
+      }
+      
+      return 0;
+    }
+#endif
+    
+    void  JQ8400_Serial::prepareToSend()
+    {
+#if MP3_ASYNC
+      // Anything already queued must go first so that commands stay in order.
+      while(this->queueCount) this->updateWaiting();
+#endif
+      
+      // If there is anything already received, deal with that now, we don't
+      //  wait for more to arrive.  Since we are not expecting anything, any 
+      //  frames in there go to the handlers (see onFrame()), as will a late
+      //  response from an earlier command which turns up while we wait for 
+      //  our own response, because it is for a different command.
+      this->rxExpect = 0;
+      while(this->inputAvailable()) 
+      {
+        this->parseResponseByte(this->inputRead());
+      }
+      this->rxIndex = 0;
+    }
+    
+#if MP3_ASYNC
+    void  JQ8400_Serial::updateWaiting()
+    {
+      this->update();
+      
+      // The next update() deals with the response, or the timeout
+      if(this->awaitingResponse)
+      {
+        uint32_t waited  = this->clockMillis() - this->rxTime;
+        uint16_t timeout = this->responseTimeout(this->rxExpect, this->rxIndex);
+        this->waitUntilAvailable(waited < timeout ? timeout - waited : 0);
+      }
+    }
+#endif
+    
+    void  JQ8400_Serial::sendFrame(uint8_t *frame)
+    {
+#if MP3_ASYNC
+      // Queued commands must go first, let the usual way deal with that
+      if(this->asyncMode || this->queueCount)
+      {
+        this->sendCommandData(frame[1], frame + 3, frame[2], 0, 0);
+        return;
+      }
+#endif
+      
+      this->prepareToSend();
+      this->_Serial->write(frame, frame[2] + 4);
+      this->frameSent(frame[1], frame + 3, frame[2]);
+    }
+    
+    void  JQ8400_Serial::frameSent(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength)
+    {
+      (void)requestBuffer; (void)requestLength; // Not used without MP3_TRACE or MP3_STATS
+      
+#if MP3_CACHE
+      this->cacheInvalidate(command);
+#endif
+      
+      // Note when we change what the device is playing, the BUSY pin changing 
+      //  soon after is our doing, not the end of the file (see readBusyPin())
+      switch(command)
+      {
+        case MP3_CMD_PLAY:
+        case MP3_CMD_PAUSE:
+        case MP3_CMD_STOP:
+        case MP3_CMD_NEXT:
+        case MP3_CMD_PREV:
+        case MP3_CMD_PLAY_IDX:
+        case MP3_CMD_SEEK_IDX:
+        case MP3_CMD_INSERT_IDX:
+        case MP3_CMD_AB_PLAY:
+        case MP3_CMD_AB_PLAY_STOP:
+        case MP3_CMD_NEXT_FOLDER:
+        case MP3_CMD_PREV_FOLDER:
+        case MP3_CMD_PLAY_FILE_FOLDER:
+        case MP3_CMD_PLAYLIST:
+        case MP3_CMD_SOURCE_SET:
+        case MP3_CMD_RESET:
+          this->playChangedAt = this->clockMillis();
+          break;
+      }
+      
+      // Playing something else abandons the rest of a playlist
+      switch(command)
+      {
+        case MP3_CMD_STOP:
+        case MP3_CMD_NEXT:
+        case MP3_CMD_PREV:
+        case MP3_CMD_PLAY_IDX:
+        case MP3_CMD_SEEK_IDX:
+        case MP3_CMD_NEXT_FOLDER:
+        case MP3_CMD_PREV_FOLDER:
+        case MP3_CMD_PLAY_FILE_FOLDER:
+        case MP3_CMD_SOURCE_SET:
+        case MP3_CMD_RESET:
+          this->playlist = 0;
+          break;
+      }
+      
+#if MP3_TRACE
+      this->traceFrame(MP3_TRACE_TX, command, requestBuffer, requestLength);
+#endif
+
+      this->sentAt = this->clockMillis();
+      
+#if MP3_STATS
+      this->stats.bytesSent += requestLength + 4;
+      this->stats.commands[statsIndex(command)].sent++;
+#endif
+    }
+    
+    void  JQ8400_Serial::transmitFrame(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength)
+    {
+      // The whole frame is assembled and written in one go, each write() can
+      //  have a significant overhead (SoftwareSerial, USB) and this way there
+      //  are no gaps between the bytes on the wire.
+      if(!requestLength)
+      {
+        uint8_t frame[4] = { MP3_CMD_BEGIN, command, 0, (uint8_t)(MP3_CMD_BEGIN + command) };
+        this->_Serial->write(frame, sizeof(frame));
+      }
+      else
+      {
+        // Very long requests (play lists) don't fit, they are sent in pieces
+        MP3FrameWriter frame(this->_Serial, command, requestLength);
+        for(uint8_t x = 0; x < requestLength; x++)
+        {
+          frame.put(requestBuffer[x]);
+        }
+        frame.end();
+      }
       
-      uint8_t      i = 0;
-      uint8_t      j = 0;
-      uint8_t      dataCount = 0;
-      while(this->waitUntilAvailable(150))
+      this->frameSent(command, requestBuffer, requestLength);
+    }
+    
+#if MP3_ASYNC
+    uint8_t JQ8400_Serial::queueCommand(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength, uint8_t responseType, MP3Result *result, MP3ResultCallback callback)
+    {
+      if(this->queueCount >= MP3_QUEUE_LENGTH || requestLength > MP3_QUEUE_DATA_LENGTH) return 0;
+      
+      MP3QueuedCommand &q = this->queue[(this->queueHead + this->queueCount) % MP3_QUEUE_LENGTH];
+      q.command      = command;
+      q.length       = requestLength;
+      q.responseType = responseType;
+      q.result       = result;
+      q.callback     = callback;
+      if(requestLength) memcpy(q.data, requestBuffer, requestLength);
+      
+#if MP3_CACHE
+      // Cached answers must not outlive a command waiting to change them
+      this->cacheInvalidate(command);
+#endif
+      
+      if(result)
       {
-        j = this->_Serial->read();
-                
-#if MP3_DEBUG
-        HEX_PRINT(j); Serial.print(" ");
+        result->state   = MP3_RESULT_PENDING;
+        result->command = command;
+        result->value   = 0;
+      }
+      
+      this->queueCount++;
+      return 1;
+    }
 #endif
-        if(i == 2)
+    
+    uint8_t JQ8400_Serial::update()
+    {
+      // Take whatever has arrived so far, never waiting for more.
+      while(this->inputAvailable())
+      {
+        uint8_t result = this->parseResponseByte(this->inputRead());
+#if MP3_ASYNC
+        this->rxTime   = this->clockMillis();
+        
+        if(result == MP3_FRAME_INCOMPLETE) continue;
+        
+        // Frames which are not the response we are waiting for have already
+        //  gone to the handlers, see frameReceived()
+        if(this->awaitingResponse && this->rxCommand == this->rxExpect)
         {
-          // The number of data bytes to read
-          dataCount = j;
+          this->completeQueued(result == MP3_FRAME_OK ? MP3_RESULT_OK : MP3_RESULT_CHECKSUM);
         }
+#else
+        (void)result; // Nothing is waited for here, frames go to frameReceived()
+#endif
+      }
+      
+#if MP3_ASYNC
+      // Time for the device to start responding, then between bytes
+      if(this->awaitingResponse && (this->clockMillis() - this->rxTime) >= this->responseTimeout(this->rxExpect, this->rxIndex))
+      {
+        uint8_t command = this->rxExpect;
+#if MP3_TRACE
+        this->traceFrame(MP3_TRACE_RX | MP3_TRACE_TIMEOUT, command, 0, 0);
+#endif
+        this->completeQueued(MP3_RESULT_TIMEOUT);
+#if MP3_ADAPTIVE_TIMEOUTS
+        this->timingTimeout(command);
+#else
+        (void)command;
+#endif
+      }
+      
+      // Send the next command, one per update() so we don't flood the device
+      if(!this->awaitingResponse && this->queueCount)
+      {
+        MP3QueuedCommand &q = this->queue[this->queueHead];
+        this->transmitFrame(q.command, q.data, q.length);
         
-        // We only record the data bytes so bytes 0,1 and 2 are discarded
-        //   except for calculating checksum
-        if(i <= 2) 
+        if(q.responseType == MP3_RESPONSE_NONE)
         {
-          MP3_CHECKSUM += j;
-          i++;
-          continue;
+          this->completeQueued(MP3_RESULT_OK);
         }
         else
         {
-          if(dataCount > 0)
-          {
-            // This is a databyte to read
-            if((i-3) <= (bufferLength-1))
-            {
-              responseBuffer[i-3] = j;
-            }
-            i++;
-            dataCount--;
-            MP3_CHECKSUM += j;
-          }
-          else
-          {
-            // This is the checksum byte
-            if((MP3_CHECKSUM & 0xFF) != j)
-            {
-              // Checksum Failed
-              #if MP3_DEBUG
-                Serial.print(" ** CHECKSUM FAILED " );
-                HEX_PRINT((MP3_CHECKSUM & 0xFF)); 
-                Serial.print(" != ");
-                HEX_PRINT(j); 
-              #endif
-              memset(responseBuffer, 0, bufferLength);
-            }
-            else
-            {
-               #if MP3_DEBUG
-                Serial.print(" ** CHECKSUM OK " );
-                HEX_PRINT((MP3_CHECKSUM & 0xFF)); 
-                Serial.print(" == ");
-                HEX_PRINT(j); 
-              #endif
-            }
-          }
+          this->rxBuffer         = 0;
+          this->rxIndex          = 0;
+          this->rxExpect         = q.command;
+          this->rxTime           = this->clockMillis();
+          this->awaitingResponse = 1;
         }
       }
+#endif
+      
+      if(this->busyPin != MP3_NO_PIN) this->readBusyPin();
+      
+      // Send the next part of a long playlist once the device has finished the 
+      //  last part, which we find out by asking the status now and then.
+#if MP3_ASYNC
+      if(this->playlist && !this->queueCount)
+#else
+      if(this->playlist)
+#endif
+      {
+        if(this->playlistNext)
+        {
+          this->playlistPart();
+        }
+        else if(this->clockMillis() - this->playlistCheckedAt >= MP3_PLAYLIST_CHECK_INTERVAL)
+        {
+          this->playlistCheckedAt = this->clockMillis();
+#if MP3_ASYNC
+          this->queueCommand(MP3_CMD_STATUS, 0, 0, MP3_RESPONSE_BYTE, 0, playlistStatus);
+#else
+          // Without the queue we still don't wait for the answer, update() 
+          //  reads it in its own time and frameReceived() takes care of it
+          this->playlistAsked = 1;
+          this->sendFixedFrame<MP3_CMD_STATUS>();
+#endif
+        }
+      }
+      
+#if MP3_ASYNC
+      return this->queueCount;
+#else
+      return 0;
+#endif
+    }
+    
+#if MP3_ASYNC
+    void JQ8400_Serial::completeQueued(uint8_t status)
+    {
+      // Take a copy and release the slot before calling back, the callback 
+      //  is allowed to queue more commands.
+      MP3QueuedCommand q = this->queue[this->queueHead];
       
-#if MP3_DEBUG      
-      Serial.print("] --> ");
-      for(uint8_t x = 0; x < bufferLength; x++)
+      // Conveniently, the MP3_RESPONSE_... constants are also the response lengths
+      if(status == MP3_RESULT_OK && q.responseType != MP3_RESPONSE_NONE && this->rxLength != q.responseType)
       {
-        HEX_PRINT(responseBuffer[x]);
+        status = MP3_RESULT_LENGTH;
       }
       
-      Serial.println();
+#if MP3_STATS
+      if(q.responseType != MP3_RESPONSE_NONE) this->statsResponse(q.command, status);
+#endif
+#if MP3_ADAPTIVE_TIMEOUTS
+      if(q.responseType != MP3_RESPONSE_NONE && status == MP3_RESULT_OK) this->timingResponse(q.command, this->clockMillis() - this->sentAt);
 #endif
+      this->queueHead = (this->queueHead + 1) % MP3_QUEUE_LENGTH;
+      this->queueCount--;
+      this->awaitingResponse = 0;
+      this->rxBuffer         = 0;
+      this->rxExpect         = 0;
+      
+      if(!q.result && !q.callback) return;
       
+      MP3Result  local;
+      MP3Result &result = q.result ? *q.result : local;
+      result.command    = q.command;
+      result.value      = 0;
+      
+      if(status == MP3_RESULT_OK)
+      {
+        switch(q.responseType)
+        {
+          case MP3_RESPONSE_BYTE: result.value = this->rxData[0]; break;
+          case MP3_RESPONSE_UINT: result.value = ((uint16_t)this->rxData[0]<<8) | this->rxData[1]; break;
+          case MP3_RESPONSE_TIME: result.value = (this->rxData[0]*60*60) + (this->rxData[1]*60) + this->rxData[2]; break;
+        }
+#if MP3_CACHE
+        this->cacheStore(q.command, result.value);
+#endif
+      }
+      
+      result.state = status;
+      
+      if(q.callback) q.callback(*this, result);
     }
+#endif
+    
+#if MP3_STATS
+    void JQ8400_Serial::resetStats()
+    {
+      memset(&this->stats, 0, sizeof(this->stats));
+    }
+    
+    uint8_t JQ8400_Serial::statsIndex(uint8_t command)
+    {
+      switch(command)
+      {
+        case MP3_CMD_STATUS:                   return 1;
+        case MP3_CMD_GET_SOURCES:              return 2;
+        case MP3_CMD_GET_SOURCE:               return 3;
+        case MP3_CMD_COUNT_FILES:              return 4;
+        case MP3_CMD_CURRENT_FILE_IDX:         return 5;
+        case MP3_CMD_FIRST_FILE_IN_FOLDER_IDX: return 6;
+        case MP3_CMD_COUNT_IN_FOLDER:          return 7;
+        case MP3_CMD_CURRENT_FILE_NAME:        return 8;
+        case MP3_CMD_CURRENT_FILE_LEN:         return 9;
+        case MP3_CMD_CURRENT_FILE_POS:         return 10;
+        default:                               return 0;
+      }
+    }
+    
+    void JQ8400_Serial::statsResponse(uint8_t command, uint8_t status)
+    {
+      MP3CommandStats &c = this->stats.commands[statsIndex(command)];
+      switch(status)
+      {
+        case MP3_RESULT_OK:
+        {
+          uint16_t rtt = this->clockMillis() - this->sentAt;
+          if(!c.responses || rtt < c.rttMin) c.rttMin = rtt;
+          if(rtt > c.rttMax) c.rttMax = rtt;
+          c.rttTotal += rtt;
+          c.responses++;
+          break;
+        }
+        
+        case MP3_RESULT_CHECKSUM: c.checksumFailures++; break;
+        case MP3_RESULT_LENGTH:   c.lengthMismatches++; break;
+        case MP3_RESULT_TIMEOUT:  
+          c.timeouts++;
+          if(this->rxIndex) c.interByteTimeouts++;
+          c.lastTimeout = this->responseTimeout(command, this->rxIndex);
+          break;
+      }
+    }
+#endif
+    
+    uint16_t JQ8400_Serial::responseTimeout(uint8_t command, uint8_t started)
+    {
+      if(started) return this->timeoutInterByte;
+      if(this->probeTimeout) return this->probeTimeout;
+      
+#if MP3_ADAPTIVE_TIMEOUTS
+      // Until we have seen a few, we don't know what to expect
+      MP3Timing &t = this->timing[this->timingClass(command)];
+      if(!this->adaptiveTimeouts || t.samples < 3) return this->timeoutFirstByte;
+      
+      uint32_t timeout = (t.srtt >> 3) + t.rttvar;
+      if(timeout < MP3_TIMEOUT_MIN)         timeout = MP3_TIMEOUT_MIN;
+      if(timeout > this->timeoutFirstByte)  timeout = this->timeoutFirstByte;
+      return timeout;
+#else
+      (void)command;
+      return this->timeoutFirstByte;
+#endif
+    }
+    
+#if MP3_ADAPTIVE_TIMEOUTS
+    uint8_t JQ8400_Serial::timingClass(uint8_t command)
+    {
+      switch(command)
+      {
+        case MP3_CMD_STATUS:
+        case MP3_CMD_GET_SOURCES:
+        case MP3_CMD_GET_SOURCE:
+        case MP3_CMD_COUNT_FILES:
+        case MP3_CMD_COUNT_IN_FOLDER:
+        case MP3_CMD_CURRENT_FILE_IDX:
+        case MP3_CMD_FIRST_FILE_IN_FOLDER_IDX:
+          return MP3_TIMING_QUERY;
+          
+        case MP3_CMD_CURRENT_FILE_LEN:
+        case MP3_CMD_CURRENT_FILE_POS:
+          return MP3_TIMING_TIME;
+          
+        case MP3_CMD_CURRENT_FILE_NAME:
+          return MP3_TIMING_NAME;
+      }
+      return MP3_TIMING_OTHER;
+    }
+    
+    void JQ8400_Serial::timingResponse(uint8_t command, uint16_t rtt)
+    {
+      MP3Timing &t = this->timing[this->timingClass(command)];
+      
+      if(!t.samples)
+      {
+        t.srtt   = rtt << 3;
+        t.rttvar = rtt << 1;
+      }
+      else
+      {
+        // srtt = 7/8 srtt + 1/8 rtt, rttvar = 3/4 rttvar + 1/4 |srtt - rtt|
+        int16_t delta = rtt - (t.srtt >> 3);
+        t.srtt   += delta;
+        t.rttvar += (delta < 0 ? -delta : delta) - (t.rttvar >> 2);
+      }
+      
+      if(t.samples < 255) t.samples++;
+    }
+    
+    void JQ8400_Serial::timingTimeout(uint8_t command)
+    {
+      // We didn't wait as long as usual, says nothing about the device
+      if(this->probeTimeout) return;
+      
+      // Perhaps the device is just slower now, back off
+      MP3Timing &t = this->timing[this->timingClass(command)];
+      t.rttvar = t.rttvar < 0x7FFF ? t.rttvar * 2 : 0xFFFF;
+    }
+#endif
+    
+#if MP3_TRACE
+    void JQ8400_Serial::traceFrame(uint8_t flags, uint8_t command, uint8_t *data, uint8_t length)
+    {
+      MP3TraceRecord &r = this->trace[(this->traceHead + this->traceCount) % MP3_TRACE_LENGTH];
+      if(this->traceCount < MP3_TRACE_LENGTH) 
+      {
+        this->traceCount++;
+      }
+      else
+      {
+        // Full, overwrite the oldest
+        this->traceHead = (this->traceHead + 1) % MP3_TRACE_LENGTH;
+      }
+      
+      r.time    = this->clockMillis();
+      r.flags   = flags;
+      r.command = command;
+      r.length  = length;
+      for(uint8_t x = 0; x < sizeof(r.data); x++)
+      {
+        r.data[x] = (data && x < length) ? data[x] : 0;
+      }
+    }
+    
+    uint8_t JQ8400_Serial::getTrace(MP3TraceRecord *buffer, uint8_t bufferLength)
+    {
+      uint8_t x = 0;
+      for(; x < this->traceCount && x < bufferLength; x++)
+      {
+        buffer[x] = this->trace[(this->traceHead + x) % MP3_TRACE_LENGTH];
+      }
+      return x;
+    }
+    
+    void JQ8400_Serial::dumpTrace(Print &output)
+    {
+      for(uint8_t x = 0; x < this->traceCount; x++)
+      {
+        MP3TraceRecord &r = this->trace[(this->traceHead + x) % MP3_TRACE_LENGTH];
+        
+        // TIME FLAGS COMMAND LENGTH DATA, all hex
+        output.print((unsigned long)r.time, HEX);    output.print(' ');
+        HEX_PRINT_TO(output, r.flags);               output.print(' ');
+        HEX_PRINT_TO(output, r.command);             output.print(' ');
+        HEX_PRINT_TO(output, r.length);              output.print(' ');
+        for(uint8_t y = 0; y < sizeof(r.data); y++)
+        {
+          HEX_PRINT_TO(output, r.data[y]);
+        }
+        output.println();
+      }
+    }
+#endif
     
-
 // Waits until data becomes available, or a timeout occurs
 int JQ8400_Serial::waitUntilAvailable(uint16_t maxWaitTime)
 {
   uint32_t startTime;
   int c = 0;
-  startTime = millis();
+  startTime = this->clockMillis();
   do {
-    c = this->_Serial->available();
+    c = this->inputAvailable();
     if (c) break;
-  } while(millis() - startTime < maxWaitTime);
+    
+    uint32_t waited = this->clockMillis() - startTime;
+    if(waited >= maxWaitTime) break;
+    
+    this->idle(maxWaitTime - waited);
+  } while(this->clockMillis() - startTime < maxWaitTime);
   
   return c;
 }
+
+void JQ8400_Serial::setReceiveBuffer(uint8_t *buffer, uint8_t length)
+{
+  // Stop onReceive() using the old ring before we change it
+  this->ringBuffer    = 0;
+  this->ringHead      = 0;
+  this->ringTail      = 0;
+  this->ringOverflows = 0;
+  this->ringLength    = length;
+  this->ringBuffer    = length > 1 ? buffer : 0;
+}
+
+size_t JQ8400_Serial::onReceive(const uint8_t *data, size_t length)
+{
+  volatile uint8_t *ring = this->ringBuffer;
+  if(!ring) return 0;
+  
+  uint8_t head = this->ringHead;
+  size_t  x;
+  for(x = 0; x < length; x++)
+  {
+    uint8_t next = head + 1;
+    if(next >= this->ringLength) next = 0;
+    
+    // Full, one slot is always left empty so that full and empty differ
+    if(next == this->ringTail) break;
+    
+    ring[head] = data[x];
+    head       = next;
+  }
+  
+  // Publish the bytes only once they are all stored
+  this->ringHead = head;
+  
+  this->ringOverflows += length - x;
+  return x;
+}
+
+void JQ8400_Serial::idleYield(JQ8400_Serial &player, uint16_t remaining)
+{
+  (void)player; (void)remaining;
+  yield();
+}
+
+void JQ8400_Serial::idleDelay(JQ8400_Serial &player, uint16_t remaining)
+{
+  (void)remaining;
+  player.clockDelay(1);
+}
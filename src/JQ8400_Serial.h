@@ -29,6 +29,8 @@
 #ifndef JQ8400Serial_h
 #define JQ8400Serial_h
 
+#include <Arduino.h>
+
 #define MP3_EQ_NORMAL     0
 #define MP3_EQ_POP        1
 #define MP3_EQ_ROCK       2
@@ -62,18 +64,374 @@
 #define MP3_STATUS_PLAYING 1
 #define MP3_STATUS_PAUSED  2
 
-// The response from a status query could be unreliable
-//  we can increase this to check multiple times.
-#define MP3_STATUS_CHECKS_IN_AGREEMENT 1
+// The response from a status query could be unreliable, when a corrupted 
+//  response is detected getStatus() asks again until this many agree.
+#ifndef MP3_STATUS_CHECKS_IN_AGREEMENT
+  #define MP3_STATUS_CHECKS_IN_AGREEMENT 2
+#endif
+
+// Set to 1 to be able to queue commands and requests to be sent by update(),
+//  see setAsync() and requestStatus() etc, this costs about 60 bytes of RAM 
+//  (on AVR) so is off by default.
+#ifndef MP3_ASYNC
+  #define MP3_ASYNC 0
+#endif
+
+// Commands sent while in async mode (see setAsync()) and requests
+//  (see requestStatus() etc) wait in a queue of this many entries.
+#ifndef MP3_QUEUE_LENGTH
+  #define MP3_QUEUE_LENGTH 4
+#endif
+
+// Queued commands can carry up to this many bytes of request data, 
+//  anything with more data than this is sent immediately (blocking).
+#ifndef MP3_QUEUE_DATA_LENGTH
+  #define MP3_QUEUE_DATA_LENGTH 4
+#endif
+
+// Playlists longer than this many files are sent to the device in parts, 
+//  the next part when the device stops at the end of the last, see playSequence()
+#ifndef MP3_PLAYLIST_FRAME_ENTRIES
+  #define MP3_PLAYLIST_FRAME_ENTRIES 127
+#endif
+
+// Each entry is 2 bytes and the frame length is a single byte
+static_assert(MP3_PLAYLIST_FRAME_ENTRIES >= 1 && MP3_PLAYLIST_FRAME_ENTRIES <= 127, "MP3_PLAYLIST_FRAME_ENTRIES must be 1 to 127");
+
+// How often (ms) update() asks if the device has finished a part of a playlist
+#define MP3_PLAYLIST_CHECK_INTERVAL 500
+
+// In MP3FolderMapEntry.number, the files in the folder are not numbered in FAT order
+#define MP3_FOLDER_UNNUMBERED 0xFFFF
+
+// Give this to setBusyPin() to stop using the BUSY pin
+#define MP3_NO_PIN 255
+
+// After we send a command which changes what is playing the BUSY pin may 
+//  change because of it (stopping, or starting another file), a change within 
+//  this time (ms) is not taken to mean the device finished playing, see onFinished()
+#ifndef MP3_BUSY_SETTLE_TIME
+  #define MP3_BUSY_SETTLE_TIME 250
+#endif
+
+// reset() waits up to this long (ms) for the device to answer, see setResetTimeout()
+#ifndef MP3_RESET_TIMEOUT
+  #define MP3_RESET_TIMEOUT 2000
+#endif
+
+// reset() asks if the device is ready, waiting this long (ms) for an answer, 
+//  then twice as long each time it doesn't, up to MP3_RESET_PROBE_MAX
+#define MP3_RESET_PROBE_FIRST 10
+#define MP3_RESET_PROBE_MAX   80
+
+// The state of an asynchronous request, in MP3Result.state, and the 
+//  outcome of the last query, see lastResult()
+#define MP3_RESULT_OK         0
+#define MP3_RESULT_PENDING    1
+#define MP3_RESULT_TIMEOUT    2
+#define MP3_RESULT_CHECKSUM   3
+#define MP3_RESULT_LENGTH     4
+#define MP3_RESULT_NO_SOURCES 5  ///< From reset() only
+
+// Set to 1 to be able to remember the answers to queries for a time, see 
+//  setCacheTime(), this costs 13 bytes of RAM (on AVR) for each of the 
+//  MP3_CACHE_QUERIES, 65 in all, so is off by default.
+#ifndef MP3_CACHE
+  #define MP3_CACHE 0
+#endif
+
+// Default time (ms) to wait for the device to start responding, and then 
+//  between bytes of the response, see setTimeouts()
+#define MP3_TIMEOUT_FIRST_BYTE 1000
+#define MP3_TIMEOUT_INTER_BYTE 150
+
+// Set to 1 to be able to learn how long to wait for responses, see 
+//  setAdaptiveTimeouts(), this costs about 20 bytes of RAM (on AVR) so is off by default.
+#ifndef MP3_ADAPTIVE_TIMEOUTS
+  #define MP3_ADAPTIVE_TIMEOUTS 0
+#endif
 
-#define MP3_DEBUG 0
+// Adaptive timeouts (see setAdaptiveTimeouts()) are never shorter than this (ms)
+#define MP3_TIMEOUT_MIN        20
+
+// Commands are grouped by how long the device takes to answer them, each 
+//  group has its own adaptive timeout
+#define MP3_TIMING_QUERY  0   ///< Status, source, counts and index numbers
+#define MP3_TIMING_TIME   1   ///< File length and position
+#define MP3_TIMING_NAME   2   ///< File name
+#define MP3_TIMING_OTHER  3
+#define MP3_TIMING_CLASSES 4
+
+// Queries which can have their answers cached, see setCacheTime()
+#define MP3_CACHE_STATUS      0
+#define MP3_CACHE_SOURCE      1
+#define MP3_CACHE_COUNT_FILES 2
+#define MP3_CACHE_FILE_INDEX  3
+#define MP3_CACHE_SOURCES     4
+#define MP3_CACHE_QUERIES     5
+
+// Number of handlers which can be registered with onFrame(), each costs 3 bytes
+//  of RAM (on AVR), the default of 0 leaves onFrame() out.
+#ifndef MP3_FRAME_HANDLERS
+  #define MP3_FRAME_HANDLERS 0
+#endif
+
+// Frame handlers (see onFrame()) are given only this many of the data bytes of
+//  a frame, though they are told its whole length; that covers the numbers and
+//  times, a late file name is cut short.
+#define MP3_FRAME_DATA_LENGTH 4
+
+// Give this to onFrame() instead of a command byte to receive all unexpected frames
+#define MP3_FRAME_ANY 0x00
+
+// Set to 1 to keep counters and round trip times of commands, see getStats()
+//  this costs about 250 bytes of RAM (on AVR) so is off by default.
+#ifndef MP3_STATS
+  #define MP3_STATS 0
+#endif
+
+// Number of entries in MP3Stats.commands, one for each query the library 
+//  sends, and one for every other command together, see getCommandStats()
+#define MP3_STATS_COMMANDS 11
+
+// Set to 1 to record the last MP3_TRACE_LENGTH frames sent and received
+//  in RAM (8 bytes each), see dumpTrace().  Recording is cheap enough to 
+//  leave on without disturbing the timing of the conversation with the device.
+#ifndef MP3_TRACE
+  #define MP3_TRACE 0
+#endif
+
+#ifndef MP3_TRACE_LENGTH
+  #define MP3_TRACE_LENGTH 16
+#endif
+
+// Flags of an MP3TraceRecord
+#define MP3_TRACE_TX           0x00
+#define MP3_TRACE_RX           0x01
+#define MP3_TRACE_BAD_CHECKSUM 0x02
+#define MP3_TRACE_TIMEOUT      0x04
 
 #define HEX_PRINT(a) if(a < 16) Serial.print(0); Serial.print(a, HEX);
+#define HEX_PRINT_TO(p, a) if(a < 16) p.print(0); p.print(a, HEX);
+
+class JQ8400_Serial;
+
+/** The outcome of an asynchronous request, see JQ8400_Serial::requestStatus() etc.
+ * 
+ */
+
+struct MP3Result
+{
+  volatile uint8_t state;   ///< MP3_RESULT_PENDING until update() completes the request, then MP3_RESULT_OK, MP3_RESULT_TIMEOUT, MP3_RESULT_CHECKSUM or MP3_RESULT_LENGTH
+  uint8_t          command; ///< The command byte which was sent
+  uint16_t         value;   ///< The response, as would be returned by the equivalent blocking method
+};
+
+/** Called by JQ8400_Serial::update() when an asynchronous request completes.  */
+
+typedef void (*MP3ResultCallback)(JQ8400_Serial &player, MP3Result &result);
+
+#if MP3_STATS
+/** Statistics for one command byte, see JQ8400_Serial::getStats()
+ * 
+ *  The average round trip time is rttTotal / responses
+ */
+
+struct MP3CommandStats
+{
+  uint16_t sent;              ///< Number of times the command was sent
+  uint16_t responses;         ///< Number of good responses received
+  uint16_t checksumFailures;  ///< Number of responses with a bad checksum
+  uint16_t lengthMismatches;  ///< Number of responses with a good checksum but the wrong amount of data
+  uint16_t timeouts;          ///< Number of times the response didn't arrive (completely)
+  uint16_t interByteTimeouts; ///< Of those timeouts, the number where the response started but didn't finish
+  uint16_t lastTimeout;       ///< The time (ms) waited for the last timeout which happened
+  uint16_t rttMin;            ///< Shortest round trip time (ms) of good responses
+  uint16_t rttMax;            ///< Longest round trip time (ms) of good responses
+  uint32_t rttTotal;          ///< Total round trip time (ms) of good responses
+};
+
+/** Statistics for the connection, see JQ8400_Serial::getStats() */
+
+struct MP3Stats
+{
+  uint32_t bytesSent;         ///< Bytes written to the device
+  uint32_t bytesReceived;     ///< Bytes read from the device
+  uint32_t garbageBytes;      ///< Bytes read which were not part of a response we wanted (eg, cleared before sending a command)
+  MP3CommandStats commands[MP3_STATS_COMMANDS]; ///< Per command statistics, see JQ8400_Serial::getCommandStats()
+};
+#endif
+
+#if MP3_TRACE
+/** A frame sent to, or received from, the device, see JQ8400_Serial::dumpTrace() */
+
+struct MP3TraceRecord
+{
+  uint16_t time;      ///< Low 16 bits of millis() at the time
+  uint8_t  flags;     ///< MP3_TRACE_TX or MP3_TRACE_RX, with MP3_TRACE_BAD_CHECKSUM or MP3_TRACE_TIMEOUT
+  uint8_t  command;   ///< Command byte
+  uint8_t  length;    ///< Number of data bytes in the frame
+  uint8_t  data[3];   ///< The first (up to) 3 data bytes
+};
+#endif
+
+/** A folder on the media, see JQ8400_Serial::buildFolderMap() */
+
+struct MP3FolderMapEntry
+{
+  uint16_t first;   ///< FAT index number of the first file in the folder, 0 if the folder wasn't found
+  uint16_t count;   ///< Number of files in the folder
+  uint16_t number;  ///< File number (name) of the first file, the rest follow in order, or MP3_FOLDER_UNNUMBERED
+};
+
+/** Settings to apply together, see JQ8400_Serial::applyConfig() */
+
+struct MP3Config
+{
+  uint8_t volume;     ///< 0 to 30, see JQ8400_Serial::setVolume()
+  uint8_t equalizer;  ///< One of the MP3_EQ_... constants, see JQ8400_Serial::setEqualizer()
+  uint8_t loopMode;   ///< One of the MP3_LOOP_... constants, see JQ8400_Serial::setLoopMode()
+};
+
+/** A file in the catalogue, see JQ8400_Serial::buildCatalogue() */
+
+struct MP3CatalogueEntry
+{
+  uint16_t hash;    ///< Hash of the file name as reported by the device
+  uint16_t index;   ///< FAT index number of the file
+};
+
+/** Write a byte to storage (eg EEPROM), see JQ8400_Serial::saveCatalogue() */
+
+typedef void (*MP3StoreWriteFunction)(uint16_t address, uint8_t value);
+
+/** Read a byte from storage (eg EEPROM), see JQ8400_Serial::loadCatalogue() */
+
+typedef uint8_t (*MP3StoreReadFunction)(uint16_t address);
+
+/** Called with a frame from the device which was not a response we were waiting for, see JQ8400_Serial::onFrame()
+ * 
+ *  `length` is the number of data bytes in the frame, but only the first 
+ *  MP3_FRAME_DATA_LENGTH of them (at most) are in `data`.
+ */
+
+typedef void (*MP3FrameHandler)(JQ8400_Serial &player, uint8_t command, const uint8_t *data, uint8_t length);
+
+/** Called when the device reports the position, see JQ8400_Serial::subscribePosition() */
+
+typedef void (*MP3PositionCallback)(JQ8400_Serial &player, uint16_t seconds);
+
+/** Replacement for millis(), see JQ8400_Serial::setTimeSource() */
+
+typedef unsigned long (*MP3MillisFunction)(void);
+
+/** Replacement for delay(), see JQ8400_Serial::setTimeSource() */
+
+typedef void (*MP3DelayFunction)(unsigned long ms);
+
+/** Reads a digital input, in place of digitalRead(), see JQ8400_Serial::setBusyPin() */
+
+typedef int (*MP3PinReadFunction)(uint8_t pin);
+
+/** Called when the device finishes playing, see JQ8400_Serial::onFinished() */
+
+typedef void (*MP3FinishedCallback)(JQ8400_Serial &player);
+
+/** Called repeatedly while waiting for the device to respond, see JQ8400_Serial::setIdle() */
+
+typedef void (*MP3IdleFunction)(JQ8400_Serial &player, uint16_t remaining);
+
+/** A list of files to play in sequence, see JQ8400_Serial::playSequence()
+ * 
+ *  Files in a playlist must be in a folder called "ZH" and have 2 character 
+ *  names (eg "/ZH/01.mp3", "/ZH/A1.mp3"), each is stored as those 2 characters
+ *  exactly as they are sent to the device, so the list takes 2 bytes per file
+ *  of storage you provide (or see JQ8400_FixedPlaylist).
+ * 
+ * **Example**
+ * 
+ *     char             storage[100];
+ *     JQ8400_Playlist  announcement(storage, sizeof(storage)); // Up to 50 files
+ *     
+ *     announcement.addNumber(12);    // "/ZH/12.mp3"
+ *     announcement.addName("A1");    // "/ZH/A1.mp3"
+ *     mp3.playSequence(announcement);
+ * 
+ */
+
+class JQ8400_Playlist
+{
+  public:
+    
+    /** Create a playlist.
+     * 
+     * @param buffer       Storage for the list, it must remain valid while the list is played.
+     * @param bufferLength Length of buffer, the list holds half this many files.
+     */
+    
+    JQ8400_Playlist(char *buffer, uint16_t bufferLength) : names(buffer), size(bufferLength / 2) { }
+    
+    /** Add a file by number.
+     * 
+     * @param fileNumber 0 to 99, for "/ZH/00.mp3" to "/ZH/99.mp3"
+     * @return False if the number is not valid or the list is full.
+     */
+    
+    uint8_t addNumber(uint8_t fileNumber);
+    
+    /** Add a file by name.
+     * 
+     * @param fileName Exactly 2 characters (letters, digits, '_' or '-'), eg "A1" for "/ZH/A1.mp3"
+     * @return False if the name is not valid or the list is full.
+     */
+    
+    uint8_t addName(const char *fileName);
+    
+    /** Remove all the files. */
+    
+    void clear() { count = 0; }
+    
+    /** Number of files in the list. */
+    
+    uint16_t length() { return count; }
+    
+    /** Number of files the list can hold. */
+    
+    uint16_t capacity() { return size; }
+    
+  protected:
+    friend class JQ8400_Serial;
+    
+    char     *names;      ///< 2 characters per file, as sent to the device
+    uint16_t  size;       ///< Capacity in files
+    uint16_t  count = 0;  ///< Number of files
+};
+
+/** A JQ8400_Playlist which holds its own storage for a fixed number of files.
+ * 
+ * **Example**
+ * 
+ *     JQ8400_FixedPlaylist<20> announcement;
+ * 
+ * @tparam files Capacity of the list.
+ */
+
+template<uint16_t files> class JQ8400_FixedPlaylist : public JQ8400_Playlist
+{
+  public:
+    JQ8400_FixedPlaylist() : JQ8400_Playlist(storage, sizeof(storage)) { }
+    
+  protected:
+    char storage[files * 2];
+};
 
 class JQ8400_Serial
 {
   protected: 
      Stream *_Serial; ///< Set in the constructor, the stream (eg HardwareSerial or SoftwareSerial object) that connects us to the device.
+     
+     friend class JQ8400_Sequencer;
+     friend class JQ8400_Fleet;
     
   public: 
 
@@ -285,6 +643,171 @@ class JQ8400_Serial
     
     void playInFolderNumber(uint16_t folderNumber);
     
+    /** Find the first index and number of files of numbered folders, so that 
+     *  playFileNumberInFolderNumber() and playInFolderNumber() can play
+     *  by index number instead of having the device search for the path.
+     * 
+     *  Each folder is found by name, by playing it by path (with the volume 
+     *  turned down) and asking the device where that got to and about the 
+     *  folder, so it takes around 10 commands per folder, and playing is 
+     *  stopped; do this in setup() and again if the media changes.  The map 
+     *  is forgotten by setSource().
+     * 
+     *  The names of the first and last file (in FAT order) of a folder are 
+     *  checked, if they are numbered and the numbers run in FAT order (copy 
+     *  the files to the media in order of name, or sort the FAT, see 
+     *  playFileByIndexNumber()) files are played by index, otherwise (and 
+     *  for folders which are not found) they are played by path as before.
+     * 
+     * **Example**
+     * 
+     *     MP3FolderMapEntry folders[10];
+     *     
+     *     mp3.buildFolderMap(folders, 10);     // Folder "/01" is folders[0], "/10" is folders[9]
+     *     mp3.playFileNumberInFolderNumber(3, 6); // Plays index folders[2].first + 6 - folders[2].number
+     * 
+     * @param map               Array which is filled and kept for later use, it must remain valid.
+     * @param mapLength         Number of entries in map, one for each folder number.
+     * @param firstFolderNumber Folder number of map[0], usually 1 (for "/01")
+     * @return Number of folders found.
+     */
+    
+    uint8_t buildFolderMap(MP3FolderMapEntry *map, uint8_t mapLength, uint8_t firstFolderNumber = 1);
+    
+    /** Stop using the folder map, play folders by path. */
+    
+    void clearFolderMap() { folderMap = 0; folderMapLength = 0; }
+    
+    /** @name File Catalogue
+     * 
+     *  The device can only play files by index number (or by folder and 
+     *  file number), to play by name we need to know the index of each 
+     *  name.  The catalogue is a table of (hashes of) names and their 
+     *  index, sorted so a name is found quickly without asking the device.
+     * 
+     *  Building the catalogue asks the device for the name of every file, 
+     *  which takes a while, so it can be saved (eg, to EEPROM) and loaded 
+     *  again on the next boot if the media has not changed.
+     * 
+     * **Example**
+     * 
+     *     #include <EEPROM.h>
+     *     
+     *     void    storeWrite(uint16_t address, uint8_t value) { EEPROM.update(address, value); }
+     *     uint8_t storeRead(uint16_t address)                 { return EEPROM.read(address);   }
+     *     
+     *     MP3CatalogueEntry files[50];
+     *     
+     *     void setup()
+     *     {
+     *       ...
+     *       if(!mp3.loadCatalogue(files, 50, storeRead))
+     *       {
+     *         mp3.buildCatalogue(files, 50);
+     *         mp3.saveCatalogue(storeWrite);
+     *       }
+     *       
+     *       mp3.playFileByName("002.mp3");
+     *     }
+     * 
+     *  The device reports names in 8.3 form, so long names must be given 
+     *  as the device sees them (eg "HELLOW~1.MP3").  Case, dots and 
+     *  spaces do not matter.
+     */
+    ///@{
+    
+    /** Build the catalogue by seeking to every file on the current source
+     *  and asking its name, this takes 2 commands per file and playing is stopped.
+     * 
+     * @param table       Array which is filled and kept for later use, it must remain valid.
+     * @param tableLength Number of entries in table, files past this are not catalogued.
+     * @return Number of files in the catalogue.
+     */
+    
+    uint16_t buildCatalogue(MP3CatalogueEntry *table, uint16_t tableLength);
+    
+    /** Save the catalogue, it takes 8 + 4 bytes per file (a 7 byte header and a checksum).
+     * 
+     * @param write   Function to write each byte.
+     * @param address Address of the first byte.
+     * @return Number of bytes written.
+     */
+    
+    uint16_t saveCatalogue(MP3StoreWriteFunction write, uint16_t address = 0);
+    
+    /** Load a catalogue saved by saveCatalogue(), if it is still correct for 
+     *  the media; that is it was saved for the current source, and that has 
+     *  the same number of files.
+     * 
+     * @param table       Array which is filled and kept for later use, it must remain valid.
+     * @param tableLength Number of entries in table.
+     * @param read        Function to read each byte.
+     * @param address     Address of the first byte.
+     * @return Number of files in the catalogue, 0 if the saved catalogue is no good.
+     */
+    
+    uint16_t loadCatalogue(MP3CatalogueEntry *table, uint16_t tableLength, MP3StoreReadFunction read, uint16_t address = 0);
+    
+    /** Find the FAT index number of a file from the catalogue.
+     * 
+     * Rarely, different names have the same hash in the catalogue, the only 
+     *  way to tell them apart is to seek to each and ask the device its name, 
+     *  **which stops anything playing**, so that is only done if you allow it.
+     * 
+     * @param fileName Name of the file, eg "002.mp3", any path is ignored.
+     * @param mayStop  True to seek if necessary to tell files apart (stopping playback), 
+     *                  otherwise (the default) such a file is not found.
+     * @return FAT index number, 0 if not found.
+     */
+    
+    uint16_t fileIndexByName(const char *fileName, uint8_t mayStop = 0);
+    
+    /** Play a file by name, from the catalogue.
+     * 
+     * This may seek to other files before playing (see fileIndexByName()).
+     * 
+     * @param fileName Name of the file, eg "002.mp3", any path is ignored.
+     * @return False if the file is not in the catalogue.
+     */
+    
+    uint8_t playFileByName(const char *fileName);
+    
+    /** Stop using the catalogue. */
+    
+    void clearCatalogue() { catalogue = 0; catalogueLength = 0; }
+    
+    ///@}
+    
+    /** Count the files in the folder of the current file (asks the device).
+     * 
+     * @return Number of files.
+     */
+    
+    uint16_t countFilesInFolder();
+    
+    /** Count the files in a folder, from the folder map (see buildFolderMap())
+     * 
+     * @param folderNumber 0 to 99
+     * @return Number of files, 0 if the folder is not in the map.
+     */
+    
+    uint16_t countFilesInFolder(uint16_t folderNumber);
+    
+    /** Get the FAT index number of the first file in the folder of the current file (asks the device).
+     * 
+     * @return FAT index number.
+     */
+    
+    uint16_t firstIndexInFolder();
+    
+    /** Get the FAT index number of the first file in a folder, from the folder map (see buildFolderMap())
+     * 
+     * @param folderNumber 0 to 99
+     * @return FAT index number, 0 if the folder is not in the map.
+     */
+    
+    uint16_t firstIndexInFolder(uint16_t folderNumber);
+    
     
     /** Seek to a specific file based on it's FAT index number.  
      * 
@@ -409,6 +932,43 @@ class JQ8400_Serial
     
     void setLoopMode(byte loopMode);
     
+    /** Only send setVolume(), setEqualizer() and setLoopMode() if they change something.
+     * 
+     *  The device can't tell us these settings, so we compare with what we 
+     *  last sent it, if that is what it already has then nothing is sent.  Off 
+     *  by default, because if the device was reset or power cycled behind our 
+     *  back (or missed a command) we would be wrong, call markDirty() if you 
+     *  suspect that.
+     * 
+     * @param enable True to skip settings which would not change.
+     */
+    
+    void setWriteOnChange(uint8_t enable) { writeOnChange = enable; }
+    
+    /** Forget what we sent for the volume, equalizer and loop mode, so that 
+     *   the next setting (or applyConfig()) is sent whatever it is.
+     * 
+     *  reset() does this itself.
+     */
+    
+    void markDirty() { shadowValid = 0; }
+    
+    /** Set the volume, equalizer and loop mode together, sending only the 
+     *   ones which are different from what we last sent, in one burst.
+     * 
+     *  This compares regardless of setWriteOnChange().
+     * 
+     * **Example**
+     * 
+     *     const MP3Config quiet = { 10, MP3_EQ_NORMAL, MP3_LOOP_NONE };
+     *     mp3.applyConfig(quiet);
+     * 
+     * @param config The settings.
+     * @return Number of commands sent.
+     */
+    
+    uint8_t applyConfig(const MP3Config &config);
+    
     /** Set the source to read mp3 data from.  Note that the datasheet calls this "drive".
      * 
      *  @param source One of the following...
@@ -467,9 +1027,21 @@ class JQ8400_Serial
      * worth while to include such ability (ie, power the device through 
      * a MOSFET which you can turn on/off at will).
      * 
+     * We ask the device if it is ready, quickly at first and then backing off, 
+     *  so that a device which is already running (or has just booted) is reset 
+     *  in a few milliseconds, only once it answers are the defaults (volume, 
+     *  equalizer, loop mode) set, see setResetTimeout() for how long we wait.
+     * 
+     *     uint16_t readyIn;
+     *     if(mp3.reset(&readyIn) != MP3_RESULT_OK) Serial.println(F("No MP3 Player"));
+     * 
+     * @param readyTime If not NULL, set to the time (ms) it took the device to answer.
+     * @return MP3_RESULT_OK, MP3_RESULT_NO_SOURCES if the device answered but 
+     *          never had any media (the defaults are still set), or 
+     *          MP3_RESULT_TIMEOUT if the device never answered.
      */
     
-    void reset();
+    uint8_t reset(uint16_t *readyTime = 0);
     
     /** Get the status from the device.
      * 
@@ -480,12 +1052,13 @@ class JQ8400_Serial
     
     /** Return if the device is busy (playing) or not.
      * 
-     *  Just a convenience test, equivalent to `getStatus() == MP3_STATUS_PLAYING`
+     *  Equivalent to `getStatus() == MP3_STATUS_PLAYING`, but if the BUSY pin 
+     *  is connected (see setBusyPin()) it just reads the pin.
      * 
      * @return bool
      */
     
-    uint8_t busy() { return getStatus() == MP3_STATUS_PLAYING; }
+    uint8_t busy();
     
     /** Get the current volume level.
      * 
@@ -563,12 +1136,52 @@ class JQ8400_Serial
     /** For the currently playing or paused file, return the 
      *  current position in seconds.
      * 
+     *  Asking the device for this costs two commands, if you want the position
+     *  frequently use subscribePosition() and then this just returns the 
+     *  last reported position.
+     * 
      * @return Number of seconds into the file currently played.
      * 
      */
     
     uint16_t   currentFilePositionInSeconds();
     
+    /** Have the device report the position of the current file every second.
+     * 
+     *  Once subscribed, currentFilePositionInSeconds() returns the last reported
+     *  position without having to ask the device (the reports are read whenever
+     *  update(), currentFilePositionInSeconds() or any other command is called).
+     * 
+     *  Optionally a function can be called with each report, it should not 
+     *  call any blocking methods of the player.
+     * 
+     * **Example**
+     * 
+     *     void showPosition(JQ8400_Serial &player, uint16_t seconds)
+     *     {
+     *       Serial.println(seconds);
+     *     }
+     *     
+     *     void setup()
+     *     {
+     *       ...
+     *       mp3.subscribePosition(showPosition);
+     *     }
+     *     
+     *     void loop()
+     *     {
+     *       mp3.update();
+     *     }
+     * 
+     * @param onPosition Function to call with each report (or NULL)
+     */
+    
+    void subscribePosition(MP3PositionCallback onPosition = 0);
+    
+    /** Stop the position reports started by subscribePosition() */
+    
+    void unsubscribePosition();
+    
     /** For the currently playing or paused file, return the 
      *  total length of the file in seconds.
      * 
@@ -618,6 +1231,9 @@ class JQ8400_Serial
      * 
      * pay attention that the file names are 2 digits, "`1.mp3`" is not valid.
      * 
+     * Numbers over 99 are skipped, and only the first MP3_PLAYLIST_FRAME_ENTRIES
+     * files are played, for longer lists use playSequence().
+     * 
      * @param playList An array of the numbers of files in the "ZH" folder.
      * @param listLength          Number of filenames in the list.
      * 
@@ -642,6 +1258,9 @@ class JQ8400_Serial
      *     const char * playList[] = { "1B", "A1", "AZ" };
      *     mp3.playSequenceByFileName(playList, sizeof(playList)/sizeof(char *));
      * 
+     * Names which are not 2 characters are skipped, and only the first 
+     * MP3_PLAYLIST_FRAME_ENTRIES files are played, for longer lists use playSequence().
+     * 
      * @param playList   An array of the two character names (as strings).
      * @param listLength Number of filenames in the list.
      * 
@@ -649,41 +1268,577 @@ class JQ8400_Serial
     
     void playSequenceByFileName(const char *playList[], uint8_t listLength);
     
+    /** Play a sequence of files from a JQ8400_Playlist.
+     * 
+     * A list longer than MP3_PLAYLIST_FRAME_ENTRIES files is sent in parts,
+     * the next part is sent by update() once the device has stopped at the 
+     * end of the last (there may be a short gap), so call update() often 
+     * (eg in your loop()) and keep the playlist valid until it is done.  
+     * Playing something else abandons the rest of the list.
+     * 
+     * @param playList The list to play.
+     */
     
+    void playSequence(JQ8400_Playlist &playList);
     
-  protected:
-
-    /** Send a command to the JQ8400 module, 
+    /** Set how long to wait for responses from the device.
      * 
-     * @param command        Byte value of to send as from the datasheet.
-     * @param requestBuffer  Pointer to (or NULL) request data bytes.
-     * @param requestLength  Number of bytes in the request buffer.
-     * @param responseBuffer Buffer to store a single line of response, if NULL, no response is read.  Note that the response is NOT a null-terminated string, if you want that, do it yourself (and specify length-1).
-     * @param buffLength     Length of response buffer.
+     * The defaults (MP3_TIMEOUT_FIRST_BYTE and MP3_TIMEOUT_INTER_BYTE) are very 
+     * generous, a healthy device usually answers in a few ms.  With adaptive 
+     * timeouts (see setAdaptiveTimeouts()) firstByte is the most we will wait.
      * 
+     * @param firstByte Milliseconds to wait for the device to start responding.
+     * @param interByte Milliseconds to wait between bytes of the response.
      */
     
-    void sendCommandData(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength, uint8_t *responseBuffer, uint8_t bufferLength);
+    void setTimeouts(uint16_t firstByte, uint16_t interByte) { timeoutFirstByte = firstByte; timeoutInterByte = interByte; }
     
-    /** Send a command with no arguments and no response. 
+#if MP3_ADAPTIVE_TIMEOUTS
+    /** Learn how long to wait for responses from the device.
      * 
-     * @param command       Byte value of to send as from the datasheet.
+     * The round trip time of responses to each group of commands (status and
+     * the like, file length and position, file name...) is measured, and a 
+     * smoothed average and variance kept (as TCP does), the time waited for 
+     * the device to start responding is then the average plus 4 times the 
+     * variance, no less than MP3_TIMEOUT_MIN and no more than set by setTimeouts().
+     * 
+     * So a lost response costs tens of ms instead of a second, if a timeout 
+     * happens the wait for that group is doubled, in case the device is just slow.
+     * 
+     * Only available when MP3_ADAPTIVE_TIMEOUTS is defined as 1.
+     * 
+     * @param adaptive True to learn the timeouts, False to use the fixed timeouts (default).
      */
     
-    inline void sendCommand(uint8_t command, uint8_t *responseBuffer = 0, uint8_t bufferLength = 0) 
-    { 
-      sendCommandData(command, NULL,  0, responseBuffer, bufferLength);
-    }
+    void setAdaptiveTimeouts(uint8_t adaptive) { adaptiveTimeouts = adaptive; }
+#endif
     
-    /** Send a command with a single 8 bit argument and no response. 
+    /** Get the time we would currently wait for the device to start responding to a command.
      * 
-     * @param command       Byte value of to send as from the datasheet.
-     * @param arg           Single byte of data
+     * @param command Byte value as from the datasheet (eg 0x01 for the status).
+     * @return Milliseconds.
      */
     
-    inline void sendCommand(uint8_t command, uint8_t arg, uint8_t *responseBuffer = 0, uint8_t bufferLength = 0)
+    uint16_t getTimeout(uint8_t command) { return responseTimeout(command, 0); }
+    
+    /** Set how long reset() waits for the device to answer.
+     * 
+     * @param maxWaitTime Milliseconds, default MP3_RESET_TIMEOUT (2 seconds).
+     */
+    
+    void setResetTimeout(uint16_t maxWaitTime) { resetTimeout = maxWaitTime; }
+    
+    /** Set how many times a query is sent again, straight away, if the response 
+     *   times out, fails the checksum or has the wrong length.
+     * 
+     * Retrying after a timeout waits for the timeout again, so with a device which 
+     *  is not there at all each query takes (retries+1) times as long to fail.
+     * 
+     * @param retries Number of retries, default 0.
+     */
+    
+    void setRetries(uint8_t retries) { queryRetries = retries; }
+    
+    /** Get the outcome of the last query (getStatus(), countFiles() etc).
+     * 
+     * Queries return 0 when they fail, this lets you tell that apart from 
+     *  a real answer of 0.
+     * 
+     *     uint16_t files = mp3.countFiles();
+     *     if(mp3.lastResult() != MP3_RESULT_OK) { ... }
+     * 
+     * @return MP3_RESULT_OK, MP3_RESULT_TIMEOUT, MP3_RESULT_CHECKSUM or MP3_RESULT_LENGTH
+     */
+    
+    uint8_t lastResult() { return queryResult; }
+    
+    /** Set a function to call while waiting for the device to respond.
+     * 
+     * Waiting for a response can take up to the timeout (see setTimeouts()), 
+     *  by default we just spin checking for input, the idle function lets 
+     *  you do something more useful with that time; give other tasks a go, 
+     *  sleep, or get on with some other work.  It is called over and over 
+     *  until the response arrives or time runs out, so should return promptly.
+     * 
+     * Two are provided...
+     * 
+     *  * JQ8400_Serial::idleYield calls yield(), which keeps the ESP8266 
+     *    watchdog happy and lets other cooperative tasks run.
+     *  * JQ8400_Serial::idleDelay waits 1ms at a time with delay(), on the ESP32 
+     *    (and other FreeRTOS based cores) this is vTaskDelay() so the idle task 
+     *    gets to run (and the CPU can power down) rather than tripping the watchdog.
+     * 
+     * Or your own, for example to get on with other work...
+     * 
+     *     void pollButtons(JQ8400_Serial &player, uint16_t remaining)
+     *     {
+     *       buttons.read();
+     *     }
+     *     
+     *     mp3.setIdle(pollButtons);
+     * 
+     * If you want to sleep, bear in mind that many chips can not receive 
+     *  serial data in light sleep (and a UART wakeup loses the bytes which 
+     *  woke it), so only sleep for less time than the device takes to start 
+     *  responding (see getTimeout() and setAdaptiveTimeouts()), not for all 
+     *  of the remaining time.
+     * 
+     * If you use setTimeSource() then the idle function (if any) must make 
+     *  time pass, idleDelay does.
+     * 
+     * @param idleFunction Function called with the player and the time (ms) 
+     *   left before the wait times out, or NULL to spin (default).
+     */
+    
+    void setIdle(MP3IdleFunction idleFunction) { idleHandler = idleFunction; }
+    
+    /** Idle function which calls yield(), see setIdle() */
+    
+    static void idleYield(JQ8400_Serial &player, uint16_t remaining);
+    
+    /** Idle function which waits 1ms with delay() (or the setTimeSource() delay), see setIdle() */
+    
+    static void idleDelay(JQ8400_Serial &player, uint16_t remaining);
+    
+    /** Use a different time source than millis() and delay().
+     * 
+     * This is mostly useful for testing, with a simulated clock (see 
+     * extras/emulator/JQ8400_VirtualClock.h) the timeouts waiting for the 
+     * device take no real time at all.
+     * 
+     * When a delay function is given, waiting for the device is done by 
+     * calling it for 1ms at a time, rather than checking millis() constantly, 
+     * so that a simulated clock advances while we wait (unless setIdle() 
+     * gives an idle function, which must then make time pass itself).
+     * 
+     * @param millisFunction Function returning milliseconds, or NULL for millis()
+     * @param delayFunction  Function which waits a number of milliseconds, or NULL for delay()
+     */
+    
+    void setTimeSource(MP3MillisFunction millisFunction, MP3DelayFunction delayFunction)
+    {
+      _millis = millisFunction;
+      _delay  = delayFunction;
+    }
+    
+#if MP3_STATS
+    /** Get the statistics collected since the start, or the last resetStats()
+     * 
+     * Only available when MP3_STATS is defined as 1.
+     * 
+     * **Example**
+     * 
+     *     const MP3Stats &stats = mp3.getStats();
+     *     Serial.print(stats.bytesReceived);
+     *     Serial.print(mp3.getCommandStats(0x01).timeouts); // 0x01 is the status query
+     * 
+     * @return Statistics structure
+     */
+    
+    const MP3Stats &getStats() { return stats; }
+    
+    /** Get the statistics of one command.
+     * 
+     *  Each query (status, file counts, index numbers, times, names...) has 
+     *  its own, to keep the RAM used down the commands which don't expect a 
+     *  response share one between them, which only counts them sent.
+     * 
+     *  Only available when MP3_STATS is defined as 1.
+     * 
+     * @param command Command byte as from the datasheet.
+     * @return Statistics of the command (or of all the commands without their own).
+     */
+    
+    const MP3CommandStats &getCommandStats(uint8_t command) { return stats.commands[statsIndex(command)]; }
+    
+    /** Zero all the statistics. */
+    
+    void resetStats();
+#endif
+    
+#if MP3_TRACE
+    /** Print the recorded trace of frames, oldest first.
+     * 
+     * Only available when MP3_TRACE is defined as 1.
+     * 
+     * Each frame is printed on a line as hex "TIME FLAGS COMMAND LENGTH DATA", 
+     * the output can be made readable with extras/trace/decode_trace.py
+     * 
+     * **Example**
+     * 
+     *     mp3.dumpTrace(Serial);
+     * 
+     * @param output Where to print (eg Serial)
+     */
+    
+    void dumpTrace(Print &output);
+    
+    /** Copy the recorded trace of frames, oldest first.
+     * 
+     * @param buffer       Array of records to fill.
+     * @param bufferLength Number of records in buffer.
+     * @return Number of records copied.
+     */
+    
+    uint8_t getTrace(MP3TraceRecord *buffer, uint8_t bufferLength);
+    
+    /** Forget the recorded trace. */
+    
+    void clearTrace() { traceCount = 0; }
+#endif
+    
+#if MP3_FRAME_HANDLERS
+    /** Register a function to handle frames the device sends on its own.
+     * 
+     *  Every frame received from the device is matched up with the command 
+     *  we are waiting for a response to (if any), those which do not match
+     *  (for example, position reports, or a response which arrived too late)
+     *  are given to the handler registered for their command byte, and 
+     *  to the handler registered for MP3_FRAME_ANY.
+     * 
+     *  Frames are received whenever update() or any command is called, the 
+     *  handler should not call any blocking methods of the player.
+     * 
+     *  The handler is told how many data bytes the frame had, but is given
+     *  only the first MP3_FRAME_DATA_LENGTH of them.
+     * 
+     *  Only available when MP3_FRAME_HANDLERS is defined as 1 or more.
+     * 
+     * **Example**
+     * 
+     *     void unexpected(JQ8400_Serial &player, uint8_t command, const uint8_t *data, uint8_t length)
+     *     {
+     *       Serial.print(F("Unexpected frame for command "));
+     *       Serial.println(command, HEX);
+     *     }
+     *     
+     *     mp3.onFrame(MP3_FRAME_ANY, unexpected);
+     * 
+     * @param command Command byte as from the datasheet, or MP3_FRAME_ANY
+     * @param handler Function to call, or NULL to remove the handler for that command
+     * @return False if there are already MP3_FRAME_HANDLERS registered
+     */
+    
+    uint8_t onFrame(uint8_t command, MP3FrameHandler handler);
+#endif
+    
+    /** @name Busy Pin
+     * 
+     *  The BUSY output of the module is active while it is playing, if you 
+     *  connect that to an input we can read it instead of asking the device, 
+     *  so busy() costs no serial traffic at all, and getStatus() only needs 
+     *  to ask when it isn't playing (to tell paused from stopped).
+     * 
+     *  Watching the pin also tells us when the device finishes playing, 
+     *  see onFinished(), whenever update(), busy() or getStatus() is called.
+     * 
+     * **Example**
+     * 
+     *     void finished(JQ8400_Serial &player)
+     *     {
+     *       Serial.println(F("Finished"));
+     *     }
+     *     
+     *     mp3.setBusyPin(7);
+     *     mp3.onFinished(finished);
+     * 
+     */
+    ///@{
+    
+    /** Set the input the BUSY pin of the module is connected to.
+     * 
+     * @param pin          Arduino pin number, or MP3_NO_PIN to stop using it.
+     * @param activeLevel  HIGH (default) or LOW, the level of the pin while playing.
+     * @param readFunction Function to read the pin, or NULL to use digitalRead() (and 
+     *                      set the pin as an INPUT).  For example to read through 
+     *                      a port expander, or pretend in a test.
+     */
+    
+    void setBusyPin(uint8_t pin, uint8_t activeLevel = HIGH, MP3PinReadFunction readFunction = 0);
+    
+    /** Set a function to call when the device finishes playing, requires setBusyPin()
+     * 
+     * The pin going inactive within MP3_BUSY_SETTLE_TIME of us sending a command 
+     *  which changes what is playing (stop, pause, play something else...) is 
+     *  assumed to be because of that command and does not count, queries do 
+     *  not matter.  The callback should not call blocking methods of the player.
+     * 
+     * @param callback Function to call, or NULL.
+     */
+    
+    void onFinished(MP3FinishedCallback callback) { finishedCallback = callback; }
+    
+    ///@}
+    
+    /** @name Interrupt Fed Input
+     * 
+     *  Normally we read the response from the serial stream as we need it, 
+     *  if it arrives while your code is busy elsewhere it has to wait in the 
+     *  stream's own buffer, SoftwareSerial's holds only 64 bytes.
+     * 
+     *  Alternatively you can give us a buffer and then feed it from the UART 
+     *  interrupt (or DMA callback, or anything else) with onReceive(), we then 
+     *  read from that buffer instead of the stream (which we still write to).
+     * 
+     *  The buffer is a lock free ring with a single producer (onReceive()) and 
+     *  a single consumer (everything else), so onReceive() can be called from 
+     *  an interrupt without disabling interrupts around the rest of the library.
+     * 
+     * **Example (ESP32)**
+     * 
+     *     uint8_t mp3Input[128];
+     *     
+     *     void serialReceived()
+     *     {
+     *       uint8_t buf[32];
+     *       size_t  len;
+     *       while((len = Serial2.read(buf, sizeof(buf)))) mp3.onReceive(buf, len);
+     *     }
+     *     
+     *     mp3.setReceiveBuffer(mp3Input, sizeof(mp3Input));
+     *     Serial2.onReceive(serialReceived);
+     * 
+     */
+    ///@{
+    
+    /** Read responses from a buffer fed by onReceive() instead of the stream.
+     * 
+     * @param buffer Storage for the ring, it must remain valid, or NULL to go back to reading the stream.
+     * @param length Length of the buffer (up to 255), one less than this many bytes can be waiting.
+     */
+    
+    void setReceiveBuffer(uint8_t *buffer, uint8_t length);
+    
+    /** Give us bytes received from the device, see setReceiveBuffer()
+     * 
+     * Safe to call from an interrupt, but only from one place at a time.
+     * 
+     * @param data   Bytes received.
+     * @param length Number of bytes.
+     * @return Number of bytes taken, less than length if the buffer is full (the rest are lost).
+     */
+    
+    size_t onReceive(const uint8_t *data, size_t length);
+    
+    /** Number of bytes lost because the receive buffer was full, see setReceiveBuffer() */
+    
+    uint16_t receiveOverflows() { return ringOverflows; }
+    
+    ///@}
+    
+    /** @name Query Cache
+     * 
+     *  Answers to the status, source, file count and file index queries 
+     *  can be remembered for a time so that asking again (for example, 
+     *  calling busy() every time around loop()) does not go to the device.
+     * 
+     *  Commands which change the answer (play, next, stop, setSource, 
+     *  reset...) forget the cached answers they affect, so the cache only
+     *  goes stale through things the device does on its own, like reaching
+     *  the end of a file, choose the time for each query accordingly.
+     * 
+     *  Caching is off for every query until a time is set, and only 
+     *  available at all when MP3_CACHE is defined as 1.
+     * 
+     * **Example**
+     * 
+     *     mp3.setCacheTime(MP3_CACHE_STATUS, 250);       // busy() asks at most 4 times a second
+     *     mp3.setCacheTime(MP3_CACHE_COUNT_FILES, 60000); 
+     * 
+     */
+    ///@{
+    
+#if MP3_CACHE
+    /** Set how long the answer to a query is remembered.
+     * 
+     * @param query  MP3_CACHE_STATUS, MP3_CACHE_SOURCE, MP3_CACHE_COUNT_FILES, MP3_CACHE_FILE_INDEX or MP3_CACHE_SOURCES
+     * @param maxAge Milliseconds, 0 to not cache this query (default).
+     */
+    
+    void setCacheTime(uint8_t query, uint16_t maxAge);
+    
+    /** Forget all cached answers, the next of each query goes to the device. */
+    
+    void clearCache();
+    
+    /** Number of times a query was answered from the cache. 
+     * 
+     * @param query MP3_CACHE_STATUS etc
+     */
+    
+    uint16_t cacheHits(uint8_t query)   { return query < MP3_CACHE_QUERIES ? cache[query].hits   : 0; }
+    
+    /** Number of times a cached query had to go to the device. 
+     * 
+     * @param query MP3_CACHE_STATUS etc
+     */
+    
+    uint16_t cacheMisses(uint8_t query) { return query < MP3_CACHE_QUERIES ? cache[query].misses : 0; }
+#endif
+    
+    ///@}
+    
+    /** @name Asynchronous Operation
+     * 
+     *  Normally every method blocks until the device has been sent the command 
+     *  (and has answered, if an answer is needed).  In async mode commands which
+     *  don't need an answer (play(), setVolume() etc) are queued instead, and
+     *  queries can be requested with the request...() methods, in either case
+     *  nothing happens until you call update(), usually from your loop().
+     * 
+     *  Only available when MP3_ASYNC is defined as 1 (update() always is).
+     * 
+     * **Example**
+     * 
+     *     MP3Result status;
+     *     
+     *     void setup()
+     *     {
+     *       mySerial.begin(9600);
+     *       mp3.reset();
+     *       mp3.setAsync(true);
+     *       mp3.play();
+     *       mp3.requestStatus(&status);
+     *     }
+     *     
+     *     void loop()
+     *     {
+     *       mp3.update();
+     *       if(status.state != MP3_RESULT_PENDING)
+     *       {
+     *         if(status.state == MP3_RESULT_OK && status.value == MP3_STATUS_STOPPED) mp3.next();
+     *         mp3.requestStatus(&status);
+     *       }
+     *       // ... do other things, update() never waits
+     *     }
+     * 
+     *  Methods which return an answer (getStatus() etc) still block, first waiting
+     *  for anything queued to be sent.  If the queue is full when a command is
+     *  queued, that command waits for room.
+     */
+    ///@{
+    
+    /** Send queued commands and receive responses, without ever waiting.
+     * 
+     *  Call this frequently, eg every time through your loop().
+     * 
+     *  Without MP3_ASYNC there is no queue, but this still handles frames the 
+     *  device sends on its own (see subscribePosition()), the BUSY pin (see 
+     *  onFinished()) and long playlists (see playSequence()), never waiting 
+     *  for the device.
+     * 
+     * @return Number of commands still queued (including one awaiting a response).
+     */
+    
+    uint8_t update();
+    
+#if MP3_ASYNC
+    /** Turn on (or off) async mode, where commands are queued to be sent by update().
+     * 
+     * @param enable True to queue commands, false to send them immediately.
+     */
+    
+    void setAsync(uint8_t enable) { asyncMode = enable; }
+    
+    /** Request the status, the result value will be as for getStatus()
+     * 
+     * @param result   Where to store the result (or NULL), result->state is MP3_RESULT_PENDING until complete.
+     * @param callback Function to call when complete (or NULL).
+     * @return False if the queue is full.
+     */
+    
+    uint8_t requestStatus(MP3Result *result, MP3ResultCallback callback = 0)
+    {
+      return queueCommand(MP3_CMD_STATUS, 0, 0, MP3_RESPONSE_BYTE, result, callback);
+    }
+    
+    /** Request the current source, the result value will be as for getSource()
+     * 
+     * @param result   Where to store the result (or NULL), result->state is MP3_RESULT_PENDING until complete.
+     * @param callback Function to call when complete (or NULL).
+     * @return False if the queue is full.
+     */
+    
+    uint8_t requestSource(MP3Result *result, MP3ResultCallback callback = 0)
+    {
+      return queueCommand(MP3_CMD_GET_SOURCE, 0, 0, MP3_RESPONSE_BYTE, result, callback);
+    }
+    
+    /** Request the number of files, the result value will be as for countFiles()
+     * 
+     * @param result   Where to store the result (or NULL), result->state is MP3_RESULT_PENDING until complete.
+     * @param callback Function to call when complete (or NULL).
+     * @return False if the queue is full.
+     */
+    
+    uint8_t requestCountFiles(MP3Result *result, MP3ResultCallback callback = 0)
+    {
+      return queueCommand(MP3_CMD_COUNT_FILES, 0, 0, MP3_RESPONSE_UINT, result, callback);
+    }
+    
+    /** Request the current file index, the result value will be as for currentFileIndexNumber()
+     * 
+     * @param result   Where to store the result (or NULL), result->state is MP3_RESULT_PENDING until complete.
+     * @param callback Function to call when complete (or NULL).
+     * @return False if the queue is full.
+     */
+    
+    uint8_t requestCurrentFileIndexNumber(MP3Result *result, MP3ResultCallback callback = 0)
+    {
+      return queueCommand(MP3_CMD_CURRENT_FILE_IDX, 0, 0, MP3_RESPONSE_UINT, result, callback);
+    }
+    
+    /** Request the current file length, the result value will be as for currentFileLengthInSeconds()
+     * 
+     * @param result   Where to store the result (or NULL), result->state is MP3_RESULT_PENDING until complete.
+     * @param callback Function to call when complete (or NULL).
+     * @return False if the queue is full.
+     */
+    
+    uint8_t requestCurrentFileLengthInSeconds(MP3Result *result, MP3ResultCallback callback = 0)
+    {
+      return queueCommand(MP3_CMD_CURRENT_FILE_LEN, 0, 0, MP3_RESPONSE_TIME, result, callback);
+    }
+#endif
+    
+    ///@}
+    
+    
+    
+  protected:
+
+    /** Send a command to the JQ8400 module, 
+     * 
+     * @param command        Byte value of to send as from the datasheet.
+     * @param requestBuffer  Pointer to (or NULL) request data bytes.
+     * @param requestLength  Number of bytes in the request buffer.
+     * @param responseBuffer Buffer to store a single line of response, if NULL, no response is read.  Note that the response is NOT a null-terminated string, if you want that, do it yourself (and specify length-1).
+     * @param buffLength     Length of response buffer.
+     * @param expectLength   Number of data bytes the response must have, 0 for any.
+     * @return MP3_RESULT_OK, or if a response was wanted MP3_RESULT_TIMEOUT, MP3_RESULT_CHECKSUM or MP3_RESULT_LENGTH
+     */
+    
+    uint8_t sendCommandData(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength, uint8_t *responseBuffer, uint8_t bufferLength, uint8_t expectLength = 0);
+    
+    /** Send a command with no arguments and no response. 
+     * 
+     * @param command       Byte value of to send as from the datasheet.
+     */
+    
+    inline uint8_t sendCommand(uint8_t command, uint8_t *responseBuffer = 0, uint8_t bufferLength = 0) 
+    { 
+      return sendCommandData(command, NULL,  0, responseBuffer, bufferLength);
+    }
+    
+    /** Send a command with a single 8 bit argument and no response. 
+     * 
+     * @param command       Byte value of to send as from the datasheet.
+     * @param arg           Single byte of data
+     */
+    
+    inline uint8_t sendCommand(uint8_t command, uint8_t arg, uint8_t *responseBuffer = 0, uint8_t bufferLength = 0)
     { 
-      sendCommandData(command, &arg, 1, responseBuffer, bufferLength); 
+      return sendCommandData(command, &arg, 1, responseBuffer, bufferLength); 
     }
     
     /** Send a command with a 16 bit integer argument.
@@ -692,13 +1847,13 @@ class JQ8400_Serial
      * @param arg           16 bit uint16_teger data
      */
     
-    inline void sendCommand(uint8_t command, uint16_t arg, uint8_t *responseBuffer = 0, uint8_t bufferLength = 0) 
+    inline uint8_t sendCommand(uint8_t command, uint16_t arg, uint8_t *responseBuffer = 0, uint8_t bufferLength = 0) 
     { 
       #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__    
-        sendCommandData(command, ((uint8_t *)(&arg)), 2, responseBuffer, bufferLength);
+        return sendCommandData(command, ((uint8_t *)(&arg)), 2, responseBuffer, bufferLength);
       #else
         uint8_t buf[] = { *(((uint8_t *)(&arg))+1), *((uint8_t *)(&arg)) };
-        sendCommandData(command, buf, 2, responseBuffer, bufferLength);
+        return sendCommandData(command, buf, 2, responseBuffer, bufferLength);
       #endif
     }
         
@@ -717,6 +1872,55 @@ class JQ8400_Serial
      */
     
     uint8_t sendCommandWithByteResponse(uint8_t command);
+    
+    /** Send a query (no request data) and read the response, retrying as set by 
+     *   setRetries(), and record the outcome for lastResult().
+     * 
+     * @param command        Byte value of to send as from the datasheet.
+     * @param responseBuffer Buffer to store the response data.
+     * @param bufferLength   Length of response buffer.
+     * @param expectLength   Number of data bytes the response must have, 0 for any.
+     * @return One of the MP3_RESULT_... constants.
+     */
+    
+    uint8_t query(uint8_t command, uint8_t *responseBuffer, uint8_t bufferLength, uint8_t expectLength);
+
+#if MP3_CACHE
+    /** The MP3_CACHE_... query answered by a command, or MP3_CACHE_QUERIES if none. */
+    
+    uint8_t cacheQuery(uint8_t command);
+    
+    /** Get the answer to a query from the cache, if it is fresh enough.
+     * 
+     * @param command Byte value of the query as from the datasheet.
+     * @param value   Where to store the answer.
+     * @return True if the answer was cached.
+     */
+    
+    uint8_t cacheLookup(uint8_t command, uint16_t *value);
+    
+    /** Remember the answer to a query (if that query is cached). */
+    
+    void cacheStore(uint8_t command, uint16_t value);
+    
+    /** Forget the cached answers a command sent to the device could change. */
+    
+    void cacheInvalidate(uint8_t command);
+    
+    /** A cached query answer, see setCacheTime() */
+    
+    struct MP3CacheEntry
+    {
+      uint16_t value;   ///< The answer
+      uint16_t maxAge;  ///< Milliseconds the answer is good for, 0 if not cached
+      uint32_t time;    ///< clockMillis() when the answer was received
+      uint8_t  valid;   ///< True if value holds an answer
+      uint16_t hits;    ///< Number of queries answered from the cache
+      uint16_t misses;  ///< Number of queries that went to the device
+    };
+    
+    MP3CacheEntry cache[MP3_CACHE_QUERIES] = { };
+#endif
 
     
     /** Return a bitmask of the available sources.
@@ -738,10 +1942,440 @@ class JQ8400_Serial
     
     int    waitUntilAvailable(uint16_t maxWaitTime = 1000);
     
+    /** Milliseconds from the time source, see setTimeSource() */
+    
+    inline unsigned long clockMillis() { return _millis ? _millis() : millis(); }
+    
+    /** Wait using the time source, see setTimeSource() */
+    
+    inline void clockDelay(unsigned long ms) { if(_delay) _delay(ms); else delay(ms); }
+    
+    /** Read the BUSY pin (see setBusyPin()) and act on any change, which must be set.
+     * 
+     * @return True if the pin says the device is playing.
+     */
+    
+    uint8_t readBusyPin();
+    
+    /** Number of received bytes waiting, in the ring if there is one (see setReceiveBuffer()) or else the stream. */
+    
+    inline int inputAvailable() 
+    { 
+      if(!ringBuffer) return _Serial->available();
+      
+      uint8_t head = ringHead;
+      return head >= ringTail ? head - ringTail : ringLength - ringTail + head;
+    }
+    
+    /** Read one received byte (which must be available), see inputAvailable() */
+    
+    inline uint8_t inputRead()
+    {
+      if(!ringBuffer) return _Serial->read();
+      
+      uint8_t c    = ringBuffer[ringTail];
+      uint8_t next = ringTail + 1;
+      ringTail     = next >= ringLength ? 0 : next;
+      return c;
+    }
+    
+    /** Called on each pass of a wait for input, see setIdle()
+     * 
+     * @param remaining Milliseconds left before the wait times out.
+     */
+    
+    inline void idle(uint16_t remaining) 
+    { 
+      if(idleHandler) idleHandler(*this, remaining);
+      
+      // With a replacement time source, time only passes when we say so
+      else if(_delay) _delay(1);
+    }
+    
+#if MP3_STATS
+    /** Record the outcome of a command which expected a response.
+     * 
+     * @param command Byte value that was sent.
+     * @param status  One of the MP3_RESULT_... constants.
+     */
+    
+    void statsResponse(uint8_t command, uint8_t status);
+    
+    /** Where a command's statistics are kept in MP3Stats.commands
+     * 
+     * @param command Byte value that was sent.
+     * @return Index, 0 for commands which don't have their own.
+     */
+    
+    static uint8_t statsIndex(uint8_t command);
+    
+    MP3Stats stats = { };          ///< See getStats()
+#endif
+    
+    /** The time to wait for a response to a command.
+     * 
+     * @param command Byte value that was sent.
+     * @param started True if the response has started arriving.
+     * @return Milliseconds to wait for the first byte, or the next byte.
+     */
+    
+    uint16_t responseTimeout(uint8_t command, uint8_t started);
+    
+#if MP3_ADAPTIVE_TIMEOUTS
+    /** The MP3_TIMING_... group a command belongs to. */
+    
+    uint8_t timingClass(uint8_t command);
+    
+    /** Record the round trip time of a good response, for adaptive timeouts. */
+    
+    void timingResponse(uint8_t command, uint16_t rtt);
+    
+    /** Record that a response timed out, for adaptive timeouts. */
+    
+    void timingTimeout(uint8_t command);
+    
+    /** Smoothed round trip time of a group of commands, see setAdaptiveTimeouts() */
+    
+    struct MP3Timing
+    {
+      uint16_t srtt;      ///< Smoothed round trip time (ms) x 8
+      uint16_t rttvar;    ///< Smoothed variance of round trip time (ms) x 4
+      uint8_t  samples;   ///< Number of round trips measured (up to 255)
+    };
+    
+    MP3Timing timing[MP3_TIMING_CLASSES] = { };
+    uint8_t   adaptiveTimeouts = 0;                       ///< See setAdaptiveTimeouts()
+#endif
+    
+    uint16_t  timeoutFirstByte = MP3_TIMEOUT_FIRST_BYTE;  ///< See setTimeouts()
+    uint16_t  timeoutInterByte = MP3_TIMEOUT_INTER_BYTE;  ///< See setTimeouts()
+    uint16_t  resetTimeout     = MP3_RESET_TIMEOUT;       ///< See setResetTimeout()
+    uint16_t  probeTimeout     = 0;                       ///< While reset() probes, the time to wait for a response (or 0)
+    uint8_t   queryRetries     = 0;                       ///< See setRetries()
+    uint8_t   queryResult      = MP3_RESULT_OK;           ///< See lastResult()
+    uint8_t   queryCorrupted   = 0;                       ///< Number of corrupt responses (checksum or length) during the last query
+    uint32_t  sentAt           = 0;                       ///< clockMillis() when the last frame was sent
+    
+#if MP3_TRACE
+    /** Record a frame in the trace.
+     * 
+     * @param flags   MP3_TRACE_... flags
+     * @param command Command byte
+     * @param data    Data bytes (or NULL)
+     * @param length  Number of data bytes in the frame
+     */
+    
+    void traceFrame(uint8_t flags, uint8_t command, uint8_t *data, uint8_t length);
+    
+    MP3TraceRecord trace[MP3_TRACE_LENGTH];   ///< Ring of recorded frames
+    uint8_t        traceHead  = 0;            ///< Index of the oldest record in trace
+    uint8_t        traceCount = 0;            ///< Number of records in trace
+#endif
+    
+    /** Find a folder in the folder map.
+     * 
+     * @param folderNumber 0 to 99
+     * @return The entry, or NULL if the folder is not mapped.
+     */
+    
+    MP3FolderMapEntry *folderMapEntry(uint16_t folderNumber);
+    
+    /** Find the first file of a folder, by name, for buildFolderMap()
+     * 
+     * @param folderNumber 0 to 99
+     * @param from         FAT index number of the current file, where we start from.
+     * @param total        Number of files on the media.
+     * @return FAT index number of the first file in the folder, 0 if not found.
+     */
+    
+    uint16_t findFolder(uint16_t folderNumber, uint16_t from, uint16_t total);
+    
+    /** The number in the name of the current file, for buildFolderMap()
+     * 
+     * @return The number (eg 6 for "006.mp3"), or MP3_FOLDER_UNNUMBERED if the name is not a number.
+     */
+    
+    uint16_t currentFileNumber();
+    
+    /** Hash a file name, ignoring any path, case, dots and spaces. */
+    
+    static uint16_t fileNameHash(const char *fileName);
+    
+    /** Compare file names, ignoring any path, case, dots and spaces. */
+    
+    static uint8_t  fileNameMatches(const char *a, const char *b);
+    
+    MP3CatalogueEntry *catalogue         = 0;   ///< See buildCatalogue(), or NULL
+    uint16_t           catalogueLength   = 0;   ///< Number of files in catalogue
+    
+    MP3FolderMapEntry *folderMap         = 0;   ///< See buildFolderMap(), or NULL
+    uint8_t            folderMapLength   = 0;   ///< Number of folders in folderMap
+    uint8_t            folderMapFirst    = 1;   ///< Folder number of folderMap[0]
+    
+    uint8_t             positionSubscribed = 0;   ///< True if the device is reporting the position, see subscribePosition()
+    uint16_t            position           = 0;   ///< Last position reported by the device
+    MP3PositionCallback positionCallback   = 0;   ///< Called with each position report (or NULL)
+    
+    MP3MillisFunction _millis = 0; ///< Replacement for millis() or NULL, see setTimeSource()
+    MP3DelayFunction  _delay  = 0; ///< Replacement for delay() or NULL, see setTimeSource()
+    MP3IdleFunction   idleHandler = 0; ///< Called while waiting for input or NULL, see setIdle()
+    
+    uint8_t             busyPin          = MP3_NO_PIN; ///< See setBusyPin()
+    uint8_t             busyActiveLevel  = HIGH;       ///< See setBusyPin()
+    uint8_t             busyWasActive    = 0;          ///< The pin was active when last read
+    MP3PinReadFunction  busyRead         = 0;          ///< See setBusyPin()
+    MP3FinishedCallback finishedCallback = 0;          ///< See onFinished()
+    uint32_t            playChangedAt    = 0;          ///< clockMillis() when we last sent a command which changes what is playing
+    
+    // The receive ring, see setReceiveBuffer(), the producer (onReceive()) only 
+    //  writes ringHead, the consumer (inputRead()) only writes ringTail, both 
+    //  are single bytes so they are read and written atomically everywhere.
+    volatile uint8_t *ringBuffer    = 0; ///< Storage for the ring, or NULL to read the stream
+    uint8_t           ringLength    = 0; ///< Length of ringBuffer
+    volatile uint8_t  ringHead      = 0; ///< Where onReceive() puts the next byte
+    volatile uint8_t  ringTail      = 0; ///< Where inputRead() gets the next byte
+    volatile uint16_t ringOverflows = 0; ///< Bytes lost because the ring was full
+    
+    /** Send a single command frame to the device, does not wait for anything.
+     * 
+     * @param command        Byte value of to send as from the datasheet.
+     * @param requestBuffer  Pointer to (or NULL) request data bytes.
+     * @param requestLength  Number of bytes in the request buffer.
+     */
+    
+    void transmitFrame(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength);
+    
+    /** Get ready to send a command (other than by the queue); anything queued
+     *  is sent first, and anything already received is dealt with.
+     */
+    
+    void prepareToSend();
+    
+#if MP3_ASYNC
+    /** Call update(), then if a queued command is waiting for its response, 
+     *  wait (see waitUntilAvailable()) for it to arrive or time out, so that 
+     *  a loop calling this until the queue empties doesn't spin.
+     */
+    
+    void updateWaiting();
+#endif
+    
+    static const uint8_t MP3_TX_FRAME_LENGTH = 20; ///< Frames up to this long are written to the device in one piece
+    
+    /** Writes a frame to the device a byte at a time as it is encoded, 
+     *  in pieces of MP3_TX_FRAME_LENGTH, working out the checksum as it goes.
+     */
+    
+    struct MP3FrameWriter
+    {
+      MP3FrameWriter(Stream *serial, uint8_t command, uint8_t length) : serial(serial) 
+      { 
+        put(MP3_CMD_BEGIN); put(command); put(length); 
+      }
+      
+      /** Add a data byte to the frame. */
+      
+      inline void put(uint8_t c)
+      {
+        if(i == sizeof(frame))
+        {
+          serial->write(frame, i);
+          i = 0;
+        }
+        frame[i++] = c;
+        checksum  += c;
+      }
+      
+      /** Add the checksum and write what remains. */
+      
+      inline void end()
+      {
+        put(checksum);
+        serial->write(frame, i);
+      }
+      
+      Stream  *serial;
+      uint8_t  frame[MP3_TX_FRAME_LENGTH];
+      uint8_t  i        = 0;
+      uint8_t  checksum = 0;
+    };
+    
+    /** Send the next part of the playlist given to playSequence() */
+    
+    void playlistPart();
+    
+#if MP3_ASYNC
+    /** Called with the status asked for by update() while a playlist plays. */
+    
+    static void playlistStatus(JQ8400_Serial &player, MP3Result &result);
+#endif
+    
+    JQ8400_Playlist *playlist          = 0;   ///< Playlist with parts still to send, or NULL
+    uint16_t         playlistSent      = 0;   ///< Number of files of playlist sent so far
+    uint8_t          playlistNext      = 0;   ///< Set when the device has finished the last part
+    uint32_t         playlistCheckedAt = 0;   ///< clockMillis() when the part was sent or the status last asked
+#if !MP3_ASYNC
+    uint8_t          playlistAsked     = 0;   ///< Set while update() waits for the status it asked, see frameReceived()
+#endif
+    
+    /** Send a complete frame (checksum and all) with no response, without 
+     *  going through sendCommandData() unless there are queued commands.
+     * 
+     * @param frame Frame to send, the length is taken from frame[2]
+     */
+    
+    void sendFrame(uint8_t *frame);
+    
+    /** Send a command with no data and no response.
+     * 
+     *  The frame is worked out by the compiler, each byte is a constant so 
+     *  there is nothing to calculate, this is used for play(), stop() etc.
+     * 
+     * @tparam command Byte value to send as from the datasheet.
+     */
+    
+    template<uint8_t command> inline void sendFixedFrame()
+    {
+      uint8_t frame[4] = { MP3_CMD_BEGIN, command, 0, frameChecksum(command, 0, 0) };
+      sendFrame(frame);
+    }
+    
+    /** Send a command with a single byte of data and no response.
+     * 
+     *  When the data is a constant (eg `setVolume(20)`) and the call is 
+     *  inlined (link time optimisation) the whole frame is a constant.
+     * 
+     * @param command Byte value to send as from the datasheet.
+     * @param data    Single byte of data
+     */
+    
+    inline void sendFrame(uint8_t command, uint8_t data)
+    {
+      uint8_t frame[5] = { MP3_CMD_BEGIN, command, 1, data, frameChecksum(command, 1, data) };
+      sendFrame(frame);
+    }
+    
+    /** Checksum of a frame with up to one byte of data. */
+    
+    static constexpr uint8_t frameChecksum(uint8_t command, uint8_t length, uint8_t data)
+    {
+      return MP3_CMD_BEGIN + command + length + data;
+    }
+    
+    /** Record a frame which has been sent (cache, trace and statistics).
+     * 
+     * @param command        Byte value sent.
+     * @param requestBuffer  Pointer to (or NULL) request data bytes.
+     * @param requestLength  Number of bytes in the request buffer.
+     */
+    
+    void frameSent(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength);
+    
+#if MP3_ASYNC
+    /** Add a command to the asynchronous queue, see update()
+     * 
+     * @param command        Byte value of to send as from the datasheet.
+     * @param requestBuffer  Pointer to (or NULL) request data bytes, they are copied.
+     * @param requestLength  Number of bytes in the request buffer, up to MP3_QUEUE_DATA_LENGTH
+     * @param responseType   One of the MP3_RESPONSE_... constants
+     * @param result         Where to store the result when complete (or NULL).
+     * @param callback       Function to call when complete (or NULL).
+     * @return False if the queue is full.
+     */
+    
+    uint8_t queueCommand(uint8_t command, uint8_t *requestBuffer, uint8_t requestLength, uint8_t responseType, MP3Result *result, MP3ResultCallback callback);
+    
+    /** Remove the command at the head of the queue, storing the result and calling the callback.
+     * 
+     * @param status One of the MP3_RESULT_... constants
+     */
+    
+    void completeQueued(uint8_t status);
+#endif
+    
+    /** Feed one received byte to the response frame parser.
+     * 
+     * Bytes before an MP3_CMD_BEGIN are skipped, data bytes are stored 
+     * in rxBuffer (as many as fit in rxBufferLength) if the frame is for 
+     * rxExpect, and the first few in rxData whatever it is for.
+     * 
+     * @param c Byte read from the device.
+     * @return MP3_FRAME_INCOMPLETE until the checksum byte has been consumed,
+     *   then MP3_FRAME_OK or MP3_FRAME_BAD_CHECKSUM
+     */
+    
+    uint8_t parseResponseByte(uint8_t c);
+    
+    /** Called by parseResponseByte() for every good frame received, whether 
+     *  it is a response we are waiting for or not, the frame is in rxCommand,
+     *  rxLength and rxData.
+     * 
+     *  Frames which are not for rxExpect are given to the onFrame() handlers.
+     */
+    
+    void frameReceived();
+    
+    uint8_t *rxBuffer       = 0; ///< Where parseResponseByte() stores data bytes of the frame (or NULL to discard)
+    uint8_t  rxBufferLength = 0; ///< Length of rxBuffer
+    uint8_t  rxIndex        = 0; ///< Position in the frame being received, 0 is waiting for MP3_CMD_BEGIN
+    uint8_t  rxCommand      = 0; ///< Command byte of the frame being received
+    uint8_t  rxLength       = 0; ///< Number of data bytes in the frame being received
+    uint8_t  rxChecksum     = 0; ///< Running checksum of the frame being received
+    uint8_t  rxData[MP3_FRAME_DATA_LENGTH]; ///< The first data bytes of the frame being received (whatever rxBuffer is)
+    uint8_t  rxExpect       = 0; ///< Command byte we are waiting for a response to, 0 if none
+    
+#if MP3_FRAME_HANDLERS
+    /** A handler registered with onFrame() */
+    
+    struct MP3FrameHandlerEntry
+    {
+      uint8_t         command;   ///< Command byte or MP3_FRAME_ANY
+      MP3FrameHandler handler;   ///< Function to call (NULL if the entry is free)
+    };
+    
+    MP3FrameHandlerEntry frameHandlers[MP3_FRAME_HANDLERS] = { }; ///< See onFrame()
+#endif
+    
+    static const uint8_t MP3_FRAME_INCOMPLETE   = 0; ///< parseResponseByte() needs more bytes
+    static const uint8_t MP3_FRAME_OK           = 1; ///< parseResponseByte() completed a good frame
+    static const uint8_t MP3_FRAME_BAD_CHECKSUM = 2; ///< parseResponseByte() completed a frame with bad checksum
+    
+#if MP3_ASYNC
+    /** A command waiting in the asynchronous queue.  */
+    
+    struct MP3QueuedCommand
+    {
+      uint8_t           command;                      ///< Byte value to send as from the datasheet
+      uint8_t           length;                       ///< Number of bytes in data
+      uint8_t           data[MP3_QUEUE_DATA_LENGTH];  ///< Request data
+      uint8_t           responseType;                 ///< One of the MP3_RESPONSE_... constants
+      MP3Result        *result;                       ///< Where to store the result (or NULL)
+      MP3ResultCallback callback;                     ///< Function to call on completion (or NULL)
+    };
+    
+    MP3QueuedCommand queue[MP3_QUEUE_LENGTH];   ///< Ring of commands waiting for update()
+    uint8_t  queueHead        = 0;              ///< Index of the oldest command in queue
+    uint8_t  queueCount       = 0;              ///< Number of commands in queue
+    uint8_t  asyncMode        = 0;              ///< If true, commands without a response are queued, see setAsync()
+    uint8_t  awaitingResponse = 0;              ///< If true the command at queueHead has been sent and we are waiting for the response
+    uint32_t rxTime           = 0;              ///< clockMillis() when the last byte was sent or received by update()
+    
+    static const uint8_t MP3_RESPONSE_NONE = 0; ///< Queued command has no response
+    static const uint8_t MP3_RESPONSE_BYTE = 1; ///< Queued command responds with a byte
+    static const uint8_t MP3_RESPONSE_UINT = 2; ///< Queued command responds with a 16 bit integer
+    static const uint8_t MP3_RESPONSE_TIME = 3; ///< Queued command responds with hours, minutes, seconds
+#endif
+    
         
     uint8_t currentVolume = 20; ///< Record of current volume level (JQ8400 has no way to query)
     uint8_t currentEq     = 0;  ///< Record of current equalizer (JQ8400 has no way to query)
     uint8_t currentLoop   = 2;  ///< Record of current loop mode (JQ8400 has no way to query)
+    uint8_t shadowValid   = 0;  ///< MP3_SHADOW_... bits for the records above which we know the device has, see markDirty()
+    uint8_t writeOnChange = 0;  ///< See setWriteOnChange()
+    
+    static const uint8_t MP3_SHADOW_VOLUME = 1<<0; ///< currentVolume was sent
+    static const uint8_t MP3_SHADOW_EQ     = 1<<1; ///< currentEq was sent
+    static const uint8_t MP3_SHADOW_LOOP   = 1<<2; ///< currentLoop was sent
     
     /** @name Command Byte Definitions
      *